@@ -4,7 +4,14 @@
 // Refer to the lambert shader files for useful comments
 
 uniform mat4 u_Model;
-uniform mat4 u_ViewProj;
+// Per-frame values shared by every program; see FrameUniforms in uniformbuffer.h
+layout(std140) uniform FrameUniforms {
+    mat4 u_ViewProj;
+    mat4 u_InvViewProj;
+    vec3 u_Eye;
+    float u_Time;
+    ivec2 u_Dimensions;
+};
 
 in vec4 vs_Pos;
 in vec4 vs_Col;
@@ -13,7 +13,14 @@
 
 uniform vec4 u_Color; // The color with which to render this instance of geometry.
 uniform sampler2D u_Texture;
-uniform int u_Time;
+// Per-frame values shared by every program; see FrameUniforms in uniformbuffer.h
+layout(std140) uniform FrameUniforms {
+    mat4 u_ViewProj;
+    mat4 u_InvViewProj;
+    vec3 u_Eye;
+    float u_Time;
+    ivec2 u_Dimensions;
+};
 
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
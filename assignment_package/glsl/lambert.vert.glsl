@@ -16,9 +16,14 @@ uniform mat4 u_ModelInvTr;  // The inverse transpose of the model matrix.
                             // This allows us to transform the object's normals properly
                             // if the object has been non-uniformly scaled.
 
-uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformation.
-                            // We've written a static matrix for you to use for HW2,
-                            // but in HW3 you'll have to generate one yourself
+// Per-frame values shared by every program; see FrameUniforms in uniformbuffer.h
+layout(std140) uniform FrameUniforms {
+    mat4 u_ViewProj;
+    mat4 u_InvViewProj;
+    vec3 u_Eye;
+    float u_Time;
+    ivec2 u_Dimensions;
+};
 
 uniform vec4 u_Color;       // When drawing the cube instance, we'll set our uniform color to represent different block types.
 
@@ -2,16 +2,39 @@
 #include "scene/river.h"
 #include <iostream>
 
-BlockTypeWorker::BlockTypeWorker(OpenGLContext *context, Terrain *terrain, QMutex *m, int x, int z)
-    : ctx(context), m_terrain(terrain), mutex(m), x_offset(x), z_offset(z) {}
+BlockTypeWorker::BlockTypeWorker(OpenGLContext *context, Terrain *terrain, const sPtr<ZoneLoad> &zone)
+    : ctx(context), m_terrain(terrain), x_offset(zone->x), z_offset(zone->z), handle(zone->handle), m_zone(zone) {}
+
+JobHandle BlockTypeWorker::getHandle() const {
+    return handle;
+}
+
+glm::ivec2 BlockTypeWorker::getZone() const {
+    return glm::ivec2(x_offset, z_offset);
+}
 
 void BlockTypeWorker::run() {
+    if (m_zone->arena == nullptr) {
+        m_zone->arena = ZoneArena::create();
+    }
     std::vector< uPtr<Chunk> > chunks;
     for(int i = 0; i < 64; i += 16) {
         for(int j = 0; j < 64; j += 16) {
+            // The player may have left this zone behind while we were queued
+            // or partway through it; don't finish a zone nobody will see.
+            if (handle.isCancelled()) {
+                handle.exit();
+                return;
+            }
+            int slot = 4 * (i / 16) + j / 16;
+            uPtr<Chunk> &saved = m_zone->chunks[slot];
+            if (saved != nullptr) {
+                chunks.push_back(std::move(saved));
+                continue;
+            }
             int new_x = x_offset + i;
             int new_z = z_offset + j;
-            chunks.push_back(mkU<Chunk>(Chunk(ctx)));
+            chunks.push_back(mkU<Chunk>(ctx, m_zone->arena, slot));
             Chunk *chunk = chunks.back().get();
             chunk->x_offset = new_x;
             chunk->z_offset = new_z;
@@ -25,11 +48,16 @@ void BlockTypeWorker::run() {
 //        river.makeRiver();
 //        std::cout << "River Created" << std::endl;
 //    }
-    // Move the chunks off of the thread
-    mutex->lock();
-    for(unsigned int i = 0; i < chunks.size(); ++i) {
-        m_terrain->gen_chunks.push_back(std::move(chunks[i]));
+    // Move the chunks off of the thread, unless Terrain cancelled the
+    // zone in the meantime. Once tryComplete() has succeeded Terrain can
+    // no longer cancel the zone, so it will wait for these chunks.
+    // The queue only closes as Terrain is destroyed, when nobody will.
+    if (handle.tryComplete()) {
+        for(unsigned int i = 0; i < chunks.size(); ++i) {
+            if (!m_terrain->gen_queue.push(std::move(chunks[i]))) {
+                break;
+            }
+        }
     }
-    mutex->unlock();
-
+    handle.exit();
 }
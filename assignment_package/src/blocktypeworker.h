@@ -4,19 +4,27 @@
 
 class BlockTypeWorker;
 
-#include <QRunnable>
-#include <QMutex>
 #include "scene/terrain.h"
+#include "jobhandle.h"
+#include "chunkio.h"
 
-class BlockTypeWorker : public QRunnable {
+// Fills one 64 x 64 terrain generation zone with Chunks on a
+// JobSystem worker, then hands them to Terrain through gen_queue.
+// Chunks the I/O thread found saved are passed on as they are; only
+// the rest are generated.
+class BlockTypeWorker {
 private:
     OpenGLContext *ctx;
     Terrain *m_terrain;
-    QMutex *mutex;
     int x_offset, z_offset;
+    JobHandle handle;
+    sPtr<ZoneLoad> m_zone;
 public:
-    BlockTypeWorker(OpenGLContext *context, Terrain *terrain, QMutex *m, int x, int z);
-    void run() override;
+    BlockTypeWorker(OpenGLContext *context, Terrain *terrain, const sPtr<ZoneLoad> &zone);
+    JobHandle getHandle() const;
+    // Lower-left corner of the terrain generation zone this worker fills
+    glm::ivec2 getZone() const;
+    void run();
 };
 
 #endif // BLOCKTYPEWORKER_H
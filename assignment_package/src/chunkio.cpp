@@ -0,0 +1,283 @@
+#include "chunkio.h"
+#include "scene/blockcodec.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_set>
+
+ZoneLoad::ZoneLoad(int x, int z, JobHandle handle)
+    : x(x), z(z), handle(handle), chunks(), arena()
+{}
+
+ChunkIO::ChunkIO(OpenGLContext *context, RegionStore &regions, EditJournal &journal, LoadedCallback onLoaded)
+    : mp_context(context), m_regions(regions), m_journal(journal), m_onLoaded(onLoaded),
+      m_mutex(), m_wake(), m_loads(), m_saves(), m_looseSaves(false), m_prefetches(),
+      m_lastPrefetch(INT_MIN, INT_MIN), m_edits(), m_commitDeadline(),
+      m_resetJournal(false), m_checkpointId(0), m_carried(), m_checkpointEdits(),
+      m_checkpointResults(), m_keepJournal(false), m_stopping(false), m_stats(), m_thread()
+{
+    // Everything the thread touches exists by now
+    m_thread = std::thread(&ChunkIO::run, this);
+}
+
+ChunkIO::~ChunkIO() {
+    shutdown();
+}
+
+void ChunkIO::requestLoad(const sPtr<ZoneLoad> &zone) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_loads.push_back(zone);
+        ++m_stats.zonesRequested;
+    }
+    m_wake.notify_one();
+}
+
+ChunkIO::SaveRequest ChunkIO::snapshot(const Chunk &c) {
+    // Cold chunks are unpacked straight into the copy, and stay cold
+    uPtr<ChunkBlocks> blocks = mkU<ChunkBlocks>();
+    c.copyBlocks(*blocks);
+    return SaveRequest{c.x_offset >> 4, c.z_offset >> 4, std::move(blocks)};
+}
+
+void ChunkIO::requestSave(const Chunk &c) {
+    SaveRequest w = snapshot(c);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_saves.push_back(std::move(w));
+        m_looseSaves = true;
+        ++m_stats.savesRequested;
+    }
+    m_wake.notify_one();
+}
+
+void ChunkIO::logEdit(const BlockEdit &edit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_edits.empty()) {
+        // The thread is asleep, or waiting on an earlier deadline; either
+        // way it picks this one up the next time it checks
+        m_commitDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(COMMIT_MS);
+        m_wake.notify_one();
+    }
+    m_edits.push_back(edit);
+    ++m_stats.editsLogged;
+}
+
+uint64_t ChunkIO::requestCheckpoint(const std::vector<const Chunk*> &chunks, const std::vector<BlockEdit> &carried) {
+    std::vector<SaveRequest> saves;
+    for(const Chunk *c : chunks) {
+        saves.push_back(snapshot(*c));
+    }
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(SaveRequest &w : saves) {
+            m_saves.push_back(std::move(w));
+        }
+        m_stats.savesRequested += chunks.size();
+        // Every uncommitted edit is in one of the saves, so only
+        // needs committing if they don't all land
+        m_checkpointEdits.insert(m_checkpointEdits.end(), m_edits.begin(), m_edits.end());
+        m_edits.clear();
+        m_resetJournal = true;
+        m_carried = carried;
+        id = ++m_checkpointId;
+    }
+    m_wake.notify_one();
+    return id;
+}
+
+std::vector<CheckpointResult> ChunkIO::takeCheckpointResults() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<CheckpointResult> results;
+    results.swap(m_checkpointResults);
+    return results;
+}
+
+void ChunkIO::requestPrefetch(int cx, int cz) {
+    glm::ivec2 region(cx >> RegionFile::SHIFT, cz >> RegionFile::SHIFT);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (region == m_lastPrefetch) {
+            return;
+        }
+        m_lastPrefetch = region;
+        m_prefetches.push_back(glm::ivec2(cx, cz));
+    }
+    m_wake.notify_one();
+}
+
+void ChunkIO::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void ChunkIO::run() {
+    std::vector< sPtr<ZoneLoad> > loads;
+    std::vector<SaveRequest> saves;
+    Chunk reference(mp_context);
+    std::vector<glm::ivec2> prefetches;
+    std::vector<BlockEdit> edits;
+    std::vector<BlockEdit> carried;
+    std::vector<BlockEdit> checkpointEdits;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        bool commitDue = false;
+        for(;;) {
+            commitDue = !m_edits.empty() && std::chrono::steady_clock::now() >= m_commitDeadline;
+            if (m_stopping || commitDue || m_resetJournal
+                    || !m_loads.empty() || !m_saves.empty() || !m_prefetches.empty()) {
+                break;
+            }
+            if (m_edits.empty()) {
+                m_wake.wait(lock);
+            } else {
+                m_wake.wait_until(lock, m_commitDeadline);
+            }
+        }
+        if (m_stopping && m_saves.empty() && m_edits.empty() && !m_resetJournal) {
+            return;
+        }
+        loads.swap(m_loads);
+        saves.swap(m_saves);
+        prefetches.swap(m_prefetches);
+        // Edits wait out their deadline, so that one sync covers as many
+        // as possible, unless a checkpoint or shutdown needs them now
+        bool resetJournal = m_resetJournal;
+        uint64_t checkpointId = m_checkpointId;
+        if (commitDue || m_stopping || resetJournal) {
+            edits.swap(m_edits);
+        }
+        carried.swap(m_carried);
+        checkpointEdits.swap(m_checkpointEdits);
+        bool looseSaves = m_looseSaves;
+        m_looseSaves = false;
+        m_resetJournal = false;
+        if (m_stopping) {
+            // Nobody is waiting for these any more
+            loads.clear();
+            prefetches.clear();
+        }
+        m_stats.maxBatch = std::max(m_stats.maxBatch, loads.size() + saves.size());
+        lock.unlock();
+
+        size_t requested = saves.size();
+        bool saved = save(saves, reference);
+        size_t written = saves.size();
+        saves.clear();
+        m_keepJournal = m_keepJournal || (!saved && looseSaves);
+        // Only once the checkpoint's saves are on disk can its edits go.
+        // Otherwise the journal still holds every edit since the last
+        // checkpoint that landed, and the ones this one took follow them.
+        bool checkpointed = false;
+        if (resetJournal) {
+            // Without a journal, the saves landing is all there is to it
+            checkpointed = saved && !m_keepJournal && (!m_journal.isOpen() || m_journal.reset());
+            if (checkpointed) {
+                if (!carried.empty()) {
+                    m_journal.append(carried);
+                }
+            } else {
+                edits.insert(edits.begin(), checkpointEdits.begin(), checkpointEdits.end());
+            }
+            carried.clear();
+            checkpointEdits.clear();
+        }
+        bool committed = !edits.empty() && m_journal.append(edits);
+        edits.clear();
+
+        std::sort(loads.begin(), loads.end(), [](const sPtr<ZoneLoad> &a, const sPtr<ZoneLoad> &b) {
+            int ra = a->x >> (RegionFile::SHIFT + 4), rb = b->x >> (RegionFile::SHIFT + 4);
+            return ra != rb ? ra < rb : (a->z >> (RegionFile::SHIFT + 4)) < (b->z >> (RegionFile::SHIFT + 4));
+        });
+        uint64_t chunksLoaded = 0, zonesFromDisk = 0;
+        for(const sPtr<ZoneLoad> &zone : loads) {
+            // The player may have left the zone while it waited
+            if (zone->handle.isCancelled()) {
+                continue;
+            }
+            load(*zone);
+            int found = 0;
+            for(const uPtr<Chunk> &c : zone->chunks) {
+                found += c != nullptr;
+            }
+            chunksLoaded += found;
+            zonesFromDisk += found == 16;
+            m_onLoaded(zone);
+        }
+        loads.clear();
+
+        for(const glm::ivec2 &p : prefetches) {
+            m_regions.prefetch(p.x, p.y);
+        }
+        size_t prefetched = prefetches.size();
+        prefetches.clear();
+
+        lock.lock();
+        m_stats.savesCollapsed += requested - written;
+        m_stats.saveBatches += requested > 0;
+        m_stats.chunksLoaded += chunksLoaded;
+        m_stats.zonesFromDisk += zonesFromDisk;
+        m_stats.prefetches += prefetched;
+        m_stats.journalCommits += committed;
+        m_stats.checkpoints += checkpointed;
+        m_stats.failedCheckpoints += resetJournal && !checkpointed;
+        if (resetJournal) {
+            m_checkpointResults.push_back(CheckpointResult{checkpointId, checkpointed});
+        }
+    }
+}
+
+bool ChunkIO::save(std::vector<SaveRequest> &saves, Chunk &reference) {
+    if (saves.empty()) {
+        return true;
+    }
+    // Only the latest save of each Chunk needs writing
+    std::unordered_set<int64_t> seen;
+    std::vector<SaveRequest> latest;
+    for(auto it = saves.rbegin(); it != saves.rend(); ++it) {
+        int64_t key = static_cast<int64_t>((uint64_t(uint32_t(it->cx)) << 32) | uint32_t(it->cz));
+        if (seen.insert(key).second) {
+            latest.push_back(std::move(*it));
+        }
+    }
+    saves.swap(latest);
+
+    std::vector<RegionWrite> writes;
+    for(const SaveRequest &s : saves) {
+        // generateChunk() only writes the blocks it fills
+        reference.blocks().fill(EMPTY);
+        reference.generateChunk(16 * s.cx, 16 * s.cz);
+        writes.push_back(RegionWrite{s.cx, s.cz, std::vector<unsigned char>()});
+        BlockCodec::encode(*s.blocks, &reference.blocks(), writes.back().payload);
+    }
+    return m_regions.save(writes) == static_cast<int>(writes.size());
+}
+
+void ChunkIO::load(ZoneLoad &zone) {
+    zone.arena = ZoneArena::create();
+    for(int i = 0; i < 64; i += 16) {
+        for(int j = 0; j < 64; j += 16) {
+            // A miss leaves the slot EMPTY, ready for the worker to generate into
+            int slot = 4 * (i / 16) + j / 16;
+            uPtr<Chunk> c = mkU<Chunk>(mp_context, zone.arena, slot);
+            c->x_offset = zone.x + i;
+            c->z_offset = zone.z + j;
+            if (m_regions.load(c.get())) {
+                zone.chunks[slot] = std::move(c);
+            }
+        }
+    }
+}
+
+ChunkIOStats ChunkIO::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ChunkIOStats s = m_stats;
+    s.pending = m_loads.size() + m_saves.size();
+    return s;
+}
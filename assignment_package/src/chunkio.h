@@ -0,0 +1,154 @@
+#pragma once
+#ifndef CHUNKIO_H
+#define CHUNKIO_H
+
+#include "smartpointerhelp.h"
+#include "scene/chunk.h"
+#include "scene/zonearena.h"
+#include "scene/regionfile.h"
+#include "scene/editjournal.h"
+#include "jobhandle.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How a checkpoint went, as reported back to the main thread
+struct CheckpointResult {
+    uint64_t id;
+    // Every save landed and the journal was started over. If not, the
+    // journal was kept whole, and the chunks are still only safe in it.
+    bool saved;
+};
+
+// One terrain generation zone on its way into the world. The I/O thread
+// fills in whichever of its 16 Chunks were saved; a BlockTypeWorker
+// generates the rest.
+struct ZoneLoad {
+    int x, z;              // Lower-left corner of the zone
+    JobHandle handle;
+    // Indexed 4 * (x / 16) + (z / 16) within the zone,
+    // nullptr where nothing was saved
+    std::array<uPtr<Chunk>, 16> chunks;
+    // Where all 16 chunks keep their blocks, whether loaded or generated.
+    // Made by whichever thread gets to the zone first.
+    sPtr<ZoneArena> arena;
+
+    ZoneLoad(int x, int z, JobHandle handle);
+};
+
+// What the I/O thread has done so far, and what it has waiting
+struct ChunkIOStats {
+    uint64_t zonesRequested;
+    uint64_t zonesFromDisk;    // Zones found saved in full, with nothing to generate
+    uint64_t chunksLoaded;
+    uint64_t savesRequested;
+    uint64_t savesCollapsed;   // Saves replaced by a later save of the same Chunk
+    uint64_t saveBatches;
+    uint64_t prefetches;
+    uint64_t editsLogged;
+    uint64_t journalCommits;   // Groups of edits written, each with one sync
+    uint64_t checkpoints;
+    uint64_t failedCheckpoints;
+    size_t maxBatch;           // Most requests taken in one go
+    size_t pending;
+};
+
+// Runs every disk access for the world on a thread of its own, so
+// neither the render thread nor the generation workers ever wait on a
+// read or write. Requests are queued from the main thread and taken
+// in batches: the saves in a batch go first, all of a region's at once
+// and with repeat saves of a Chunk collapsed into the latest, then its
+// loads, ordered by region so each file is visited once per batch.
+// Saves going first means a zone is never loaded from behind a save of
+// it that was requested earlier.
+// It also keeps the edit journal: edits are logged as they happen and
+// committed as one group COMMIT_MS after the first of them, so a burst
+// of edits costs a single sync.
+class ChunkIO {
+public:
+    // Called on the I/O thread with each zone once its saved chunks have
+    // been read. Not called for zones cancelled while they waited.
+    using LoadedCallback = std::function<void(const sPtr<ZoneLoad>&)>;
+    static const int COMMIT_MS = 200;
+
+private:
+    OpenGLContext *mp_context;
+    RegionStore &m_regions;
+    EditJournal &m_journal;
+    LoadedCallback m_onLoaded;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector< sPtr<ZoneLoad> > m_loads;
+    // A copy of a Chunk's blocks, encoded on this thread since
+    // that means generating the Chunk again to find what changed
+    struct SaveRequest {
+        int cx, cz;
+        uPtr<ChunkBlocks> blocks;
+    };
+    std::vector<SaveRequest> m_saves;
+    // Whether m_saves holds any not made by a checkpoint
+    bool m_looseSaves;
+    // Chunk coordinates of regions to read ahead
+    std::vector<glm::ivec2> m_prefetches;
+    glm::ivec2 m_lastPrefetch;
+    // Edits not yet committed, and when they must be
+    std::vector<BlockEdit> m_edits;
+    std::chrono::steady_clock::time_point m_commitDeadline;
+    // Set by a checkpoint: once its saves are written the journal is
+    // emptied, then these edits (still not in any saved Chunk) go back in.
+    // The edits it took off m_edits are committed after all if a save fails.
+    bool m_resetJournal;
+    uint64_t m_checkpointId;
+    std::vector<BlockEdit> m_carried;
+    std::vector<BlockEdit> m_checkpointEdits;
+    std::vector<CheckpointResult> m_checkpointResults;
+    // Set on this thread when a batch with saves from outside any
+    // checkpoint fails. Their Chunks may be gone from memory, leaving the journal the only copy
+    // of their edits, so the journal isn't reset again until the world reopens.
+    bool m_keepJournal;
+    bool m_stopping;
+    ChunkIOStats m_stats;
+    std::thread m_thread;
+
+    void run();
+    void load(ZoneLoad &zone);
+    // Collapses repeat saves of a Chunk into the latest and writes them
+    // as deltas from generation. reference is scratch space. Returns
+    // false unless every one of them is on disk.
+    bool save(std::vector<SaveRequest> &saves, Chunk &reference);
+    static SaveRequest snapshot(const Chunk &c);
+
+public:
+    ChunkIO(OpenGLContext *context, RegionStore &regions, EditJournal &journal, LoadedCallback onLoaded);
+    ~ChunkIO();
+
+    void requestLoad(const sPtr<ZoneLoad> &zone);
+    // Copies c's blocks straight away, so c may be freed once this returns
+    void requestSave(const Chunk &c);
+    // Queues an edit for the next journal commit
+    void logEdit(const BlockEdit &edit);
+    // Saves chunks, which between them hold every edit logged so far
+    // except those in carried, then starts the journal over with carried.
+    // The saves and the reset are queued together, so no other batch
+    // can see one without the other. The journal is only reset if every
+    // save lands; either way the outcome is reported under the returned id.
+    uint64_t requestCheckpoint(const std::vector<const Chunk*> &chunks, const std::vector<BlockEdit> &carried);
+    // Checkpoints finished since the last call, oldest first
+    std::vector<CheckpointResult> takeCheckpointResults();
+    // Reads ahead the region holding the Chunk at (cx, cz). Repeat
+    // requests for the same region are ignored.
+    void requestPrefetch(int cx, int cz);
+
+    // Writes every save and edit still queued, drops the loads and stops the thread
+    void shutdown();
+
+    ChunkIOStats stats();
+};
+
+#endif // CHUNKIO_H
@@ -2,8 +2,10 @@
 #include <glm_includes.h>
 
 Drawable::Drawable(OpenGLContext* context)
-    : m_count(-1), m_bufIdx(), m_bufPos(), m_bufNor(), m_bufCol(),
-      m_idxGenerated(false), m_posGenerated(false), m_norGenerated(false), m_colGenerated(false),
+    : m_count(-1), m_count_trans(-1), m_bufIdx(), m_bufIdxTrans(), m_bufPos(), m_bufTrans(), m_bufNor(), m_bufCol(),
+      m_idxGenerated(false), m_idxTransGenerated(false), m_posGenerated(false), m_transGenerated(false),
+      m_norGenerated(false), m_colGenerated(false),
+      m_vao(), m_vaoGenerated(false),
       mp_context(context)
 {}
 
@@ -14,11 +16,18 @@ Drawable::~Drawable()
 void Drawable::destroy()
 {
     mp_context->glDeleteBuffers(1, &m_bufIdx);
+    mp_context->glDeleteBuffers(1, &m_bufIdxTrans);
     mp_context->glDeleteBuffers(1, &m_bufPos);
+    mp_context->glDeleteBuffers(1, &m_bufTrans);
     mp_context->glDeleteBuffers(1, &m_bufNor);
     mp_context->glDeleteBuffers(1, &m_bufCol);
-    m_idxGenerated = m_posGenerated = m_norGenerated = m_colGenerated = false;
+    if (m_vaoGenerated) {
+        mp_context->glDeleteVertexArrays(1, &m_vao);
+    }
+    m_vaoGenerated = false;
+    m_idxGenerated = m_idxTransGenerated = m_posGenerated = m_transGenerated = m_norGenerated = m_colGenerated = false;
     m_count = -1;
+    m_count_trans = -1;
 }
 
 GLenum Drawable::drawMode()
@@ -100,6 +109,15 @@ bool Drawable::bindIdxTrans()
     return m_idxTransGenerated;
 }
 
+void Drawable::bindVAO()
+{
+    if (!m_vaoGenerated) {
+        m_vaoGenerated = true;
+        mp_context->glGenVertexArrays(1, &m_vao);
+    }
+    mp_context->glBindVertexArray(m_vao);
+}
+
 bool Drawable::bindPos()
 {
     if(m_posGenerated){
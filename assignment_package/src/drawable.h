@@ -2,6 +2,12 @@
 #include <openglcontext.h>
 #include <glm_includes.h>
 
+// The attribute locations every ShaderProgram binds its inputs to before
+// linking, so a VAO set up once works with any of the programs
+enum VertexAttrib : GLuint {
+    ATTR_POS = 0, ATTR_COL = 1, ATTR_NOR = 2, ATTR_UV = 3
+};
+
 //This defines a class which can be rendered by our shader program.
 //Make any geometry a subclass of ShaderProgram::Drawable in order to render it with the ShaderProgram class.
 class Drawable
@@ -25,6 +31,9 @@ protected:
     bool m_norGenerated;
     bool m_colGenerated;
 
+    GLuint m_vao; // This Drawable's own vertex array object, so drawing it never disturbs another's attribute setup
+    bool m_vaoGenerated;
+
     OpenGLContext* mp_context; // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                           // we need to pass our OpenGL context to the Drawable in order to call GL functions
                           // from within this class.
@@ -51,6 +60,9 @@ public:
     void generateNor();
     void generateCol();
 
+    // Binds this Drawable's VAO, creating it the first time
+    void bindVAO();
+
     bool bindIdx();
     bool bindIdxTrans();
     bool bindPos();
@@ -0,0 +1,97 @@
+#include "epochmanager.h"
+#include <stdexcept>
+#include <string>
+
+// Which slot indices are taken, shared by every EpochManager
+static std::array<std::atomic<bool>, EpochManager::MAX_THREADS> s_claimed {};
+
+namespace {
+struct SlotClaim {
+    int index = -1;
+    ~SlotClaim() {
+        if (index >= 0) {
+            s_claimed[index].store(false, std::memory_order_release);
+        }
+    }
+};
+}
+static thread_local SlotClaim t_slot;
+
+int EpochManager::threadSlot() {
+    if (t_slot.index < 0) {
+        for(int i = 0; i < MAX_THREADS; ++i) {
+            bool expected = false;
+            if (s_claimed[i].compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                t_slot.index = i;
+                break;
+            }
+        }
+        if (t_slot.index < 0) {
+            throw std::runtime_error("More than " + std::to_string(MAX_THREADS) + " threads using epoch guards");
+        }
+    }
+    return t_slot.index;
+}
+
+EpochManager::EpochManager()
+    : m_slots(), m_epoch(1), m_retired(), m_retiredCount(0), m_freedCount(0)
+{
+    for(Slot &s : m_slots) {
+        s.epoch.store(0, std::memory_order_relaxed);
+        s.depth = 0;
+    }
+}
+
+EpochManager::~EpochManager() {
+    for(Retired &r : m_retired) {
+        r.free();
+    }
+}
+
+void EpochManager::enter() {
+    Slot &s = m_slots[threadSlot()];
+    if (s.depth++ == 0) {
+        s.epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+        // Nothing this thread reads from here on may be seen by a
+        // collect() that missed the store above
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void EpochManager::exit() {
+    Slot &s = m_slots[threadSlot()];
+    if (--s.depth == 0) {
+        s.epoch.store(0, std::memory_order_release);
+    }
+}
+
+void EpochManager::retire(std::function<void()> free) {
+    // Readers that enter from now on start at a later epoch,
+    // and can no longer reach what is being retired
+    uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    m_retired.push_back(Retired{epoch, std::move(free)});
+    ++m_retiredCount;
+}
+
+size_t EpochManager::collect() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for(const Slot &s : m_slots) {
+        uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    size_t freed = 0;
+    while (!m_retired.empty() && m_retired.front().epoch < oldest) {
+        m_retired.front().free();
+        m_retired.pop_front();
+        ++freed;
+    }
+    m_freedCount += freed;
+    return freed;
+}
+
+EpochStats EpochManager::stats() const {
+    return EpochStats{m_epoch.load(std::memory_order_relaxed), m_retiredCount, m_freedCount, m_retired.size()};
+}
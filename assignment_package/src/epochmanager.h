@@ -0,0 +1,90 @@
+#pragma once
+#ifndef EPOCHMANAGER_H
+#define EPOCHMANAGER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Counters describing what has been retired and freed so far
+struct EpochStats {
+    uint64_t epoch;
+    uint64_t retired;
+    uint64_t freed;
+    size_t waiting;     // Retired but not yet freed
+};
+
+// Epoch-based reclamation, for objects that other threads reach
+// through lock-free lookups. A reader stays inside an EpochGuard for as
+// long as it uses anything it found that way. The one writer (the main
+// thread) first makes an object unreachable, then retire()s it; the
+// object is only freed by a later collect() once every reader that was
+// inside a guard when it was retired has left it.
+// Entering and leaving a guard only write to a slot of the calling
+// thread's own, so readers never contend with each other.
+// Guards nest.
+class EpochManager {
+public:
+    static const int MAX_THREADS = 64;
+
+private:
+    // 0 while the thread isn't in a guard, or else the global epoch
+    // when it entered. On its own cache line so readers don't contend.
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        int depth;      // Only touched by the owning thread
+    };
+    std::array<Slot, MAX_THREADS> m_slots;
+    std::atomic<uint64_t> m_epoch;
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> free;
+    };
+    // Oldest first. Only touched by the writer.
+    std::deque<Retired> m_retired;
+    uint64_t m_retiredCount;
+    uint64_t m_freedCount;
+
+    // The calling thread's index into m_slots, claimed on first use
+    // and given back when the thread exits
+    static int threadSlot();
+
+public:
+    EpochManager();
+    // Frees everything still retired; no reader may be left by then
+    ~EpochManager();
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    void enter();
+    void exit();
+
+    // Writer only. free runs in a later collect(), or when this is destroyed.
+    void retire(std::function<void()> free);
+    // Writer only. Frees whatever no reader can still be using,
+    // returning how many objects that was.
+    size_t collect();
+
+    EpochStats stats() const;
+};
+
+class EpochGuard {
+private:
+    EpochManager &m_epochs;
+
+public:
+    explicit EpochGuard(EpochManager &epochs) : m_epochs(epochs) {
+        m_epochs.enter();
+    }
+    ~EpochGuard() {
+        m_epochs.exit();
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+#endif // EPOCHMANAGER_H
@@ -0,0 +1,92 @@
+#include "freelistallocator.h"
+#include <algorithm>
+
+FreeListAllocator::FreeListAllocator(size_t capacity)
+    : m_free(), m_capacity(capacity), m_used(0)
+{
+    if (capacity > 0) {
+        m_free[0] = capacity;
+    }
+}
+
+bool FreeListAllocator::allocate(size_t size, size_t &offset) {
+    if (size == 0) {
+        offset = 0;
+        return true;
+    }
+    for(auto it = m_free.begin(); it != m_free.end(); ++it) {
+        if (it->second >= size) {
+            offset = it->first;
+            size_t remaining = it->second - size;
+            m_free.erase(it);
+            if (remaining > 0) {
+                m_free[offset + size] = remaining;
+            }
+            m_used += size;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FreeListAllocator::free(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    m_used -= size;
+    auto next = m_free.lower_bound(offset);
+    // Merge with the free range that ends where this one starts
+    if (next != m_free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            m_free.erase(prev);
+        }
+    }
+    // And with the one that starts where this one ends
+    if (next != m_free.end() && offset + size == next->first) {
+        size += next->second;
+        m_free.erase(next);
+    }
+    m_free[offset] = size;
+}
+
+void FreeListAllocator::grow(size_t newCapacity) {
+    if (newCapacity <= m_capacity) {
+        return;
+    }
+    size_t oldCapacity = m_capacity;
+    m_capacity = newCapacity;
+    // Counted as used by free(), so add it back first
+    m_used += newCapacity - oldCapacity;
+    free(oldCapacity, newCapacity - oldCapacity);
+}
+
+void FreeListAllocator::clear() {
+    m_free.clear();
+    m_used = 0;
+    if (m_capacity > 0) {
+        m_free[0] = m_capacity;
+    }
+}
+
+size_t FreeListAllocator::capacity() const {
+    return m_capacity;
+}
+
+size_t FreeListAllocator::used() const {
+    return m_used;
+}
+
+size_t FreeListAllocator::largestFree() const {
+    size_t largest = 0;
+    for(const auto &range : m_free) {
+        largest = std::max(largest, range.second);
+    }
+    return largest;
+}
+
+size_t FreeListAllocator::freeRangeCount() const {
+    return m_free.size();
+}
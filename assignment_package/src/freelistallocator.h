@@ -0,0 +1,36 @@
+#pragma once
+#ifndef FREELISTALLOCATOR_H
+#define FREELISTALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+
+// Hands out ranges of some linear resource (e.g. the vertices of a GL
+// buffer) without touching the resource itself. Free ranges are kept
+// sorted by offset so that a freed range can be merged with the free
+// ranges on either side of it, and allocation takes the first free range
+// that is big enough.
+class FreeListAllocator {
+private:
+    // Offset -> size of every free range
+    std::map<size_t, size_t> m_free;
+    size_t m_capacity;
+    size_t m_used;
+
+public:
+    FreeListAllocator(size_t capacity = 0);
+
+    // Returns false if no free range is big enough
+    bool allocate(size_t size, size_t &offset);
+    void free(size_t offset, size_t size);
+    // Adds capacity at the end; existing allocations keep their offsets
+    void grow(size_t newCapacity);
+    void clear();
+
+    size_t capacity() const;
+    size_t used() const;
+    size_t largestFree() const;
+    size_t freeRangeCount() const;
+};
+
+#endif // FREELISTALLOCATOR_H
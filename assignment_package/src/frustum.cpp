@@ -0,0 +1,116 @@
+#include "frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+
+void AABBBatch::add(const AABB &box) {
+    glm::vec3 c = (box.min + box.max) * 0.5f;
+    glm::vec3 e = (box.max - box.min) * 0.5f;
+    cx.push_back(c.x);
+    cy.push_back(c.y);
+    cz.push_back(c.z);
+    ex.push_back(e.x);
+    ey.push_back(e.y);
+    ez.push_back(e.z);
+}
+
+void AABBBatch::clear() {
+    cx.clear();
+    cy.clear();
+    cz.clear();
+    ex.clear();
+    ey.clear();
+    ez.clear();
+}
+
+size_t AABBBatch::size() const {
+    return cx.size();
+}
+
+Frustum::Frustum(const glm::mat4 &viewProj)
+    : m_planes()
+{
+    // glm is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 rows[4];
+    for(int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    }
+    m_planes[0] = rows[3] + rows[0]; // Left
+    m_planes[1] = rows[3] - rows[0]; // Right
+    m_planes[2] = rows[3] + rows[1]; // Bottom
+    m_planes[3] = rows[3] - rows[1]; // Top
+    m_planes[4] = rows[3] + rows[2]; // Near
+    m_planes[5] = rows[3] - rows[2]; // Far
+    for(glm::vec4 &p : m_planes) {
+        p /= glm::length(glm::vec3(p));
+    }
+}
+
+bool Frustum::intersects(const AABB &box) const {
+    glm::vec3 c = (box.min + box.max) * 0.5f;
+    glm::vec3 e = (box.max - box.min) * 0.5f;
+    for(const glm::vec4 &p : m_planes) {
+        glm::vec3 n(p);
+        // The box is outside if even its corner furthest
+        // along the normal is behind the plane
+        float distance = glm::dot(n, c) + p.w;
+        float radius = glm::dot(glm::abs(n), e);
+        if (distance + radius < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int Frustum::cull(const AABBBatch &boxes, std::vector<unsigned char> &visible) const {
+    size_t count = boxes.size();
+    visible.resize(count);
+    int visibleCount = 0;
+    size_t i = 0;
+
+#ifdef FRUSTUM_USE_SSE
+    // Four boxes against one plane at a time
+    for(; i + 4 <= count; i += 4) {
+        __m128 cx = _mm_loadu_ps(&boxes.cx[i]);
+        __m128 cy = _mm_loadu_ps(&boxes.cy[i]);
+        __m128 cz = _mm_loadu_ps(&boxes.cz[i]);
+        __m128 ex = _mm_loadu_ps(&boxes.ex[i]);
+        __m128 ey = _mm_loadu_ps(&boxes.ey[i]);
+        __m128 ez = _mm_loadu_ps(&boxes.ez[i]);
+        // All bits set in every lane
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+        for(const glm::vec4 &p : m_planes) {
+            __m128 nx = _mm_set1_ps(p.x);
+            __m128 ny = _mm_set1_ps(p.y);
+            __m128 nz = _mm_set1_ps(p.z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(p.w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(glm::abs(p.x)), ex),
+                                                  _mm_mul_ps(_mm_set1_ps(glm::abs(p.y)), ey)),
+                                       _mm_mul_ps(_mm_set1_ps(glm::abs(p.z)), ez));
+            __m128 outside = _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps());
+            inside = _mm_andnot_ps(outside, inside);
+        }
+        int mask = _mm_movemask_ps(inside);
+        for(int j = 0; j < 4; ++j) {
+            visible[i + j] = (mask >> j) & 1;
+            visibleCount += visible[i + j];
+        }
+    }
+#endif
+
+    // Whatever is left over, or everything without SSE
+    for(; i < count; ++i) {
+        glm::vec3 c(boxes.cx[i], boxes.cy[i], boxes.cz[i]);
+        glm::vec3 e(boxes.ex[i], boxes.ey[i], boxes.ez[i]);
+        visible[i] = intersects(AABB{c - e, c + e}) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
+
+const std::array<glm::vec4, 6>& Frustum::planes() const {
+    return m_planes;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "glm_includes.h"
+#include <array>
+#include <vector>
+
+// An axis-aligned box in world space
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Many boxes stored as separate center / half-extent arrays, so the
+// frustum can test several of them at once with SIMD
+struct AABBBatch {
+    std::vector<float> cx, cy, cz;
+    std::vector<float> ex, ey, ez;
+
+    void add(const AABB &box);
+    void clear();
+    size_t size() const;
+};
+
+// The six planes bounding a camera's view volume. Each plane is stored as
+// (normal, d) with the normal pointing into the volume, so a point p is
+// inside when dot(normal, p) + d >= 0 for all six.
+class Frustum {
+private:
+    std::array<glm::vec4, 6> m_planes;
+
+public:
+    // Extracts the planes from a projection * view matrix
+    // (Gribb and Hartmann's method)
+    Frustum(const glm::mat4 &viewProj);
+
+    // Conservative: a box that only touches the corner
+    // of the frustum may still be reported as visible
+    bool intersects(const AABB &box) const;
+    // Sets visible[i] to 1 if box i intersects the frustum and 0 otherwise.
+    // Returns the number of visible boxes.
+    int cull(const AABBBatch &boxes, std::vector<unsigned char> &visible) const;
+
+    const std::array<glm::vec4, 6>& planes() const;
+};
+
+#endif // FRUSTUM_H
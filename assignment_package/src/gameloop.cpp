@@ -0,0 +1,110 @@
+#include "gameloop.h"
+#include <algorithm>
+
+TimeHistogram::TimeHistogram()
+    : counts(), total(0), sumMs(0), maxMs(0.f)
+{
+    counts.fill(0);
+}
+
+void TimeHistogram::add(float ms) {
+    int bucket = std::min(std::max(static_cast<int>(ms), 0), BUCKETS - 1);
+    ++counts[bucket];
+    ++total;
+    sumMs += ms;
+    maxMs = std::max(maxMs, ms);
+}
+
+void TimeHistogram::clear() {
+    counts.fill(0);
+    total = 0;
+    sumMs = 0;
+    maxMs = 0.f;
+}
+
+float TimeHistogram::averageMs() const {
+    return total == 0 ? 0.f : static_cast<float>(sumMs / total);
+}
+
+float TimeHistogram::percentileMs(float p) const {
+    if (total == 0) {
+        return 0.f;
+    }
+    uint32_t target = static_cast<uint32_t>(p * total);
+    uint32_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen > target || seen == total) {
+            return static_cast<float>(i + 1);
+        }
+    }
+    return static_cast<float>(BUCKETS);
+}
+
+void TimeHistogram::print(std::ostream &out) const {
+    for(int i = 0; i < BUCKETS; ++i) {
+        if (counts[i] != 0) {
+            out << " " << i << (i == BUCKETS - 1 ? "+" : "") << ":" << counts[i];
+        }
+    }
+}
+
+GameLoop::GameLoop()
+    : m_lastFrame(), m_started(false), m_accumulatorMs(0), m_ticks(0), m_droppedMs(0),
+      m_frameTimes(), m_tickTimes()
+{}
+
+int GameLoop::beginFrame() {
+    auto now = std::chrono::steady_clock::now();
+    if (!m_started) {
+        // Nothing to catch up on before the first frame
+        m_started = true;
+        m_lastFrame = now;
+        return 0;
+    }
+    float elapsed = std::chrono::duration<float, std::milli>(now - m_lastFrame).count();
+    m_lastFrame = now;
+    m_frameTimes.add(elapsed);
+
+    m_accumulatorMs += elapsed;
+    int ticks = static_cast<int>(m_accumulatorMs / TICK_MS);
+    if (ticks > MAX_TICKS_PER_FRAME) {
+        m_droppedMs += (ticks - MAX_TICKS_PER_FRAME) * TICK_MS;
+        ticks = MAX_TICKS_PER_FRAME;
+        // Keep the fractional part so interpolation stays smooth
+        m_accumulatorMs = m_accumulatorMs - static_cast<int>(m_accumulatorMs / TICK_MS) * TICK_MS;
+    } else {
+        m_accumulatorMs -= ticks * TICK_MS;
+    }
+    m_ticks += ticks;
+    return ticks;
+}
+
+float GameLoop::alpha() const {
+    return static_cast<float>(m_accumulatorMs / TICK_MS);
+}
+
+void GameLoop::recordTick(float ms) {
+    m_tickTimes.add(ms);
+}
+
+uint64_t GameLoop::tickCount() const {
+    return m_ticks;
+}
+
+double GameLoop::droppedMs() const {
+    return m_droppedMs;
+}
+
+const TimeHistogram& GameLoop::frameTimes() const {
+    return m_frameTimes;
+}
+
+const TimeHistogram& GameLoop::tickTimes() const {
+    return m_tickTimes;
+}
+
+void GameLoop::clearHistograms() {
+    m_frameTimes.clear();
+    m_tickTimes.clear();
+}
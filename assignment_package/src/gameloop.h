@@ -0,0 +1,66 @@
+#pragma once
+#ifndef GAMELOOP_H
+#define GAMELOOP_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Durations counted in 1 ms buckets; the last bucket also
+// holds everything longer than it
+struct TimeHistogram {
+    static const int BUCKETS = 64;
+    std::array<uint32_t, BUCKETS> counts;
+    uint32_t total;
+    double sumMs;
+    float maxMs;
+
+    TimeHistogram();
+    void add(float ms);
+    void clear();
+    float averageMs() const;
+    // Upper edge of the bucket holding the given percentile
+    float percentileMs(float p) const;
+    // The non-empty buckets, as "<ms>:<count>" pairs
+    void print(std::ostream &out) const;
+};
+
+// Runs the simulation at a fixed rate however fast frames are drawn.
+// Each frame, the time since the last one is added to an accumulator and
+// whole ticks are taken out of it; whatever is left over says how far
+// the renderer should interpolate between the last two simulated states.
+// After a long stall only MAX_TICKS_PER_FRAME ticks are run and the rest
+// of the time is dropped, so the simulation never spirals trying to catch up.
+class GameLoop {
+public:
+    static constexpr float TICK_MS = 1000.f / 60.f;
+    static const int MAX_TICKS_PER_FRAME = 5;
+
+private:
+    std::chrono::steady_clock::time_point m_lastFrame;
+    bool m_started;
+    double m_accumulatorMs;
+    uint64_t m_ticks;
+    double m_droppedMs;
+    // Time between frames, and CPU time spent in each tick
+    TimeHistogram m_frameTimes;
+    TimeHistogram m_tickTimes;
+
+public:
+    GameLoop();
+
+    // Call once at the start of each frame. Returns how many ticks to run.
+    int beginFrame();
+    // How far between the previous and the current tick the frame is, 0 to 1
+    float alpha() const;
+    void recordTick(float ms);
+
+    uint64_t tickCount() const;
+    double droppedMs() const;
+    const TimeHistogram& frameTimes() const;
+    const TimeHistogram& tickTimes() const;
+    void clearHistograms();
+};
+
+#endif // GAMELOOP_H
@@ -0,0 +1,171 @@
+#include "geometryarena.h"
+
+ArenaAllocation::ArenaAllocation()
+    : baseVertex(0), vertexCount(0), firstIndex(0), indexCount(0)
+{}
+
+void MultiDrawBatch::add(const ArenaAllocation &mesh) {
+    if (mesh.indexCount == 0) {
+        return;
+    }
+    counts.push_back(mesh.indexCount);
+    indexOffsets.push_back(reinterpret_cast<const void*>(mesh.firstIndex * sizeof(GLuint)));
+    baseVertices.push_back(mesh.baseVertex);
+}
+
+void MultiDrawBatch::add(const ArenaAllocation &mesh, GLsizei firstIndex, GLsizei count) {
+    if (count <= 0) {
+        return;
+    }
+    counts.push_back(count);
+    indexOffsets.push_back(reinterpret_cast<const void*>((mesh.firstIndex + firstIndex) * sizeof(GLuint)));
+    baseVertices.push_back(mesh.baseVertex);
+}
+
+void MultiDrawBatch::clear() {
+    counts.clear();
+    indexOffsets.clear();
+    baseVertices.clear();
+}
+
+GLsizei MultiDrawBatch::size() const {
+    return static_cast<GLsizei>(counts.size());
+}
+
+GeometryArena::GeometryArena(OpenGLContext *context, size_t initialVertices)
+    : mp_context(context), m_vertexBuffer(0), m_indexBuffer(0), m_vao(0),
+      // Every quad is 4 vertices and 6 indices
+      m_vertices(initialVertices), m_indices(initialVertices * 3 / 2), m_grows(0)
+{}
+
+void GeometryArena::create() {
+    mp_context->glGenBuffers(1, &m_vertexBuffer);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertexBuffer);
+    mp_context->glBufferData(GL_COPY_WRITE_BUFFER, m_vertices.capacity() * VERTEX_BYTES, nullptr, GL_STATIC_DRAW);
+
+    mp_context->glGenBuffers(1, &m_indexBuffer);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+    mp_context->glBufferData(GL_COPY_WRITE_BUFFER, m_indices.capacity() * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+
+    mp_context->glGenVertexArrays(1, &m_vao);
+    configureVAO();
+}
+
+void GeometryArena::configureVAO() {
+    // Whatever VAO is bound may be in the middle of being set up elsewhere
+    GLint previous;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+
+    mp_context->glBindVertexArray(m_vao);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    mp_context->glEnableVertexAttribArray(ATTR_POS);
+    mp_context->glVertexAttribPointer(ATTR_POS, 4, GL_FLOAT, false, VERTEX_BYTES, (void*)0);
+    mp_context->glEnableVertexAttribArray(ATTR_COL);
+    mp_context->glVertexAttribPointer(ATTR_COL, 4, GL_FLOAT, false, VERTEX_BYTES, (void*)sizeof(glm::vec4));
+    mp_context->glEnableVertexAttribArray(ATTR_NOR);
+    mp_context->glVertexAttribPointer(ATTR_NOR, 4, GL_FLOAT, false, VERTEX_BYTES, (void*)(2 * sizeof(glm::vec4)));
+    mp_context->glEnableVertexAttribArray(ATTR_UV);
+    mp_context->glVertexAttribPointer(ATTR_UV, 4, GL_FLOAT, false, VERTEX_BYTES, (void*)(3 * sizeof(glm::vec4)));
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+    mp_context->glBindVertexArray(previous);
+}
+
+void GeometryArena::destroy() {
+    mp_context->glDeleteBuffers(1, &m_vertexBuffer);
+    mp_context->glDeleteBuffers(1, &m_indexBuffer);
+    mp_context->glDeleteVertexArrays(1, &m_vao);
+    m_vertexBuffer = m_indexBuffer = m_vao = 0;
+    m_vertices.clear();
+    m_indices.clear();
+}
+
+void GeometryArena::growBuffer(GLuint &buf, GLsizeiptr oldBytes, GLsizeiptr newBytes) {
+    GLuint grown;
+    mp_context->glGenBuffers(1, &grown);
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    mp_context->glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+    // The copy stays on the GPU
+    mp_context->glBindBuffer(GL_COPY_READ_BUFFER, buf);
+    mp_context->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldBytes);
+    mp_context->glDeleteBuffers(1, &buf);
+    buf = grown;
+    configureVAO();
+}
+
+void GeometryArena::write(GLuint buf, GLintptr offset, const void *data, GLsizeiptr bytes, StagingRing *staging) {
+    mp_context->glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+    if (staging == nullptr || !staging->upload(data, bytes, offset)) {
+        mp_context->glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+    }
+}
+
+void GeometryArena::upload(ArenaAllocation &mesh, const std::vector<glm::vec4> &interleaved,
+                           const std::vector<GLuint> &idx, StagingRing *staging) {
+    free(mesh);
+    if (idx.empty()) {
+        return;
+    }
+    if (m_vertexBuffer == 0) {
+        create();
+    }
+    size_t vertexCount = interleaved.size() / VEC4S_PER_VERTEX;
+
+    size_t vertexOffset;
+    while (!m_vertices.allocate(vertexCount, vertexOffset)) {
+        size_t oldCapacity = m_vertices.capacity();
+        size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + vertexCount);
+        growBuffer(m_vertexBuffer, oldCapacity * VERTEX_BYTES, newCapacity * VERTEX_BYTES);
+        m_vertices.grow(newCapacity);
+        ++m_grows;
+    }
+    size_t indexOffset;
+    while (!m_indices.allocate(idx.size(), indexOffset)) {
+        size_t oldCapacity = m_indices.capacity();
+        size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + idx.size());
+        growBuffer(m_indexBuffer, oldCapacity * sizeof(GLuint), newCapacity * sizeof(GLuint));
+        m_indices.grow(newCapacity);
+        ++m_grows;
+    }
+
+    mesh.baseVertex = static_cast<GLint>(vertexOffset);
+    mesh.vertexCount = static_cast<GLsizei>(vertexCount);
+    mesh.firstIndex = indexOffset;
+    mesh.indexCount = static_cast<GLsizei>(idx.size());
+
+    write(m_vertexBuffer, vertexOffset * VERTEX_BYTES, interleaved.data(), vertexCount * VERTEX_BYTES, staging);
+    write(m_indexBuffer, indexOffset * sizeof(GLuint), idx.data(), idx.size() * sizeof(GLuint), staging);
+}
+
+void GeometryArena::free(ArenaAllocation &mesh) {
+    if (mesh.indexCount == 0) {
+        return;
+    }
+    m_vertices.free(mesh.baseVertex, mesh.vertexCount);
+    m_indices.free(mesh.firstIndex, mesh.indexCount);
+    mesh = ArenaAllocation();
+}
+
+void GeometryArena::bind() {
+    mp_context->glBindVertexArray(m_vao);
+}
+
+size_t GeometryArena::vertexCapacity() const {
+    return m_vertices.capacity();
+}
+
+size_t GeometryArena::verticesUsed() const {
+    return m_vertices.used();
+}
+
+size_t GeometryArena::indexCapacity() const {
+    return m_indices.capacity();
+}
+
+size_t GeometryArena::indicesUsed() const {
+    return m_indices.used();
+}
+
+uint64_t GeometryArena::growCount() const {
+    return m_grows;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include "openglcontext.h"
+#include "drawable.h"
+#include "glm_includes.h"
+#include "freelistallocator.h"
+#include "stagingring.h"
+#include <vector>
+
+// Where one mesh lives inside a GeometryArena. indexCount is 0 for
+// a mesh that has nothing in the arena.
+struct ArenaAllocation {
+    GLint baseVertex;     // First vertex, added to every index when drawing
+    GLsizei vertexCount;
+    size_t firstIndex;    // In indices, not bytes
+    GLsizei indexCount;
+
+    ArenaAllocation();
+};
+
+// The arguments of one glMultiDrawElementsBaseVertex call,
+// built up one mesh at a time
+struct MultiDrawBatch {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> indexOffsets;
+    std::vector<GLint> baseVertices;
+
+    void add(const ArenaAllocation &mesh);
+    // Draws only count indices of the mesh, starting firstIndex into it
+    void add(const ArenaAllocation &mesh, GLsizei firstIndex, GLsizei count);
+    void clear();
+    GLsizei size() const;
+};
+
+// One large vertex buffer and one large index buffer that many meshes
+// are packed into, so all of them can be drawn in a single call.
+// Vertices are interleaved pos/col/nor/uv vec4s, as built by Chunk, and
+// indices are relative to the mesh's own first vertex. Both buffers
+// double in size whenever an allocation doesn't fit.
+class GeometryArena {
+public:
+    static const int VEC4S_PER_VERTEX = 4;
+    static const GLsizeiptr VERTEX_BYTES = VEC4S_PER_VERTEX * sizeof(glm::vec4);
+
+private:
+    OpenGLContext *mp_context;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+    // Points at the two buffers, so drawing is just a bind
+    GLuint m_vao;
+    FreeListAllocator m_vertices;
+    FreeListAllocator m_indices;
+    uint64_t m_grows;
+
+    // Moves buf into a new buffer of newBytes, keeping its first oldBytes
+    void growBuffer(GLuint &buf, GLsizeiptr oldBytes, GLsizeiptr newBytes);
+    // Points m_vao at the current buffers. Called whenever one is replaced.
+    void configureVAO();
+    // Copies bytes into buf at offset
+    void write(GLuint buf, GLintptr offset, const void *data, GLsizeiptr bytes, StagingRing *staging);
+
+public:
+    GeometryArena(OpenGLContext *context, size_t initialVertices);
+
+    // The GL context must be current for these
+    void create();
+    void destroy();
+
+    // Replaces whatever mesh was in the arena with the given data. Goes
+    // through staging if one is given, or glBufferSubData otherwise.
+    void upload(ArenaAllocation &mesh, const std::vector<glm::vec4> &interleaved,
+                const std::vector<GLuint> &idx, StagingRing *staging = nullptr);
+    void free(ArenaAllocation &mesh);
+
+    // Binds the arena's VAO for drawing
+    void bind();
+
+    size_t vertexCapacity() const;
+    size_t verticesUsed() const;
+    size_t indexCapacity() const;
+    size_t indicesUsed() const;
+    uint64_t growCount() const;
+};
+
+#endif // GEOMETRYARENA_H
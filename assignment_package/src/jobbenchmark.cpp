@@ -0,0 +1,86 @@
+#include "jobbenchmark.h"
+#include "jobsystem.h"
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Roughly a few microseconds of work, so that scheduling
+// overhead dominates the measurement
+static void busyWork() {
+    volatile float f = 1.f;
+    for(int i = 0; i < 500; ++i) {
+        f = f * 1.0001f + 0.5f;
+    }
+}
+
+// Each job writes only its own slot, so no locking is needed
+static void recordStart(std::vector<int64_t> &latencies, int i, int64_t submitted) {
+    latencies[i] = nowNs() - submitted;
+    busyWork();
+}
+
+class BenchmarkRunnable : public QRunnable {
+private:
+    std::vector<int64_t> *latencies;
+    int index;
+    int64_t submitted;
+public:
+    BenchmarkRunnable(std::vector<int64_t> *l, int i)
+        : latencies(l), index(i), submitted(nowNs()) {}
+    void run() override {
+        recordStart(*latencies, index, submitted);
+    }
+};
+
+static void report(const char *name, std::vector<int64_t> latencies, int64_t totalNs) {
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    std::cout << name << ": " << totalNs / 1000000.f << " ms total, "
+              << totalNs / static_cast<float>(n) << " ns/job, start latency p50 "
+              << latencies[n / 2] / 1000.f << " us, p99 "
+              << latencies[n * 99 / 100] / 1000.f << " us, max "
+              << latencies[n - 1] / 1000.f << " us" << std::endl;
+}
+
+void runJobBenchmark(int jobCount) {
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int threads = pool->maxThreadCount();
+    std::cout << "Scheduling " << jobCount << " jobs on " << threads << " threads" << std::endl;
+
+    // QThreadPool, as the old workers were run: one heap-allocated
+    // runnable per job, deleted by the pool when it finishes
+    std::vector<int64_t> poolLatencies(jobCount);
+    int64_t start = nowNs();
+    for(int i = 0; i < jobCount; ++i) {
+        pool->start(new BenchmarkRunnable(&poolLatencies, i));
+    }
+    pool->waitForDone();
+    report("QThreadPool", poolLatencies, nowNs() - start);
+
+    std::vector<int64_t> jobLatencies(jobCount);
+    JobSystem jobs(threads);
+    int completed = 0;
+    start = nowNs();
+    for(int i = 0; i < jobCount; ++i) {
+        int64_t submitted = nowNs();
+        jobs.submit(jobs.create([&jobLatencies, i, submitted]() { recordStart(jobLatencies, i, submitted); },
+                                [&completed]() { ++completed; }));
+    }
+    while(completed < jobCount) {
+        jobs.runCompletions();
+    }
+    report("JobSystem", jobLatencies, nowNs() - start);
+
+    JobStats stats = jobs.stats();
+    std::cout << "JobSystem: " << stats.stolen << " jobs stolen, "
+              << stats.poolAllocations << " job objects allocated for "
+              << stats.submitted << " submitted" << std::endl;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#ifndef JOBBENCHMARK_H
+#define JOBBENCHMARK_H
+
+// Compares the JobSystem against QThreadPool, which Terrain used to run its
+// workers on. Both are given the same number of threads and the same batch
+// of small jobs; the total time and the submit-to-start latency of the
+// jobs are printed for each.
+// Run the program with MINIMINECRAFT_JOB_BENCHMARK set to see the results.
+void runJobBenchmark(int jobCount = 20000);
+
+#endif // JOBBENCHMARK_H
@@ -0,0 +1,35 @@
+#include "jobhandle.h"
+
+JobHandle::JobHandle()
+    : m_state(mkS<SharedState>())
+{}
+
+bool JobHandle::tryCancel() {
+    int expected = RUNNING;
+    return m_state->state.compare_exchange_strong(expected, CANCELLED);
+}
+
+bool JobHandle::tryComplete() {
+    int expected = RUNNING;
+    return m_state->state.compare_exchange_strong(expected, COMPLETED);
+}
+
+void JobHandle::exit() {
+    m_state->exited.store(true, std::memory_order_release);
+}
+
+bool JobHandle::isCancelled() const {
+    return m_state->state.load(std::memory_order_relaxed) == CANCELLED;
+}
+
+bool JobHandle::isCompleted() const {
+    return m_state->state.load(std::memory_order_acquire) == COMPLETED;
+}
+
+bool JobHandle::hasExited() const {
+    return m_state->exited.load(std::memory_order_acquire);
+}
+
+bool JobHandle::operator==(const JobHandle &other) const {
+    return m_state == other.m_state;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef JOBHANDLE_H
+#define JOBHANDLE_H
+
+#include "smartpointerhelp.h"
+#include <atomic>
+
+// A shared handle to a job that has been handed to a worker thread.
+// Terrain keeps one copy and the worker keeps the other, so Terrain can
+// ask a job to stop once the player has moved away from the area it was
+// working on, and the worker can see that request between units of work.
+//
+// A job ends in exactly one of two ways: the worker completes it, or
+// Terrain cancels it. Both go through a compare-and-swap on the same
+// state, so the two threads always agree on which one won.
+class JobHandle {
+public:
+    enum State : int {
+        RUNNING, COMPLETED, CANCELLED
+    };
+
+private:
+    struct SharedState {
+        std::atomic<int> state;
+        // Set once the worker has returned from run(); after this the
+        // worker will never touch the job's data again
+        std::atomic<bool> exited;
+
+        SharedState() : state(RUNNING), exited(false) {}
+    };
+    sPtr<SharedState> m_state;
+
+public:
+    JobHandle();
+
+    // Called by the owner. Returns true if the job had not completed yet,
+    // in which case its results will be discarded by the worker.
+    bool tryCancel();
+    // Called by the worker once its results are ready to be published.
+    // Returns false if the job was cancelled first.
+    bool tryComplete();
+    // Called by the worker as the very last thing it does.
+    void exit();
+
+    bool isCancelled() const;
+    bool isCompleted() const;
+    bool hasExited() const;
+
+    // Do both handles refer to the same job?
+    bool operator==(const JobHandle &other) const;
+};
+
+#endif // JOBHANDLE_H
@@ -0,0 +1,312 @@
+#include "jobsystem.h"
+#include <algorithm>
+#include <chrono>
+
+// Which worker of which JobSystem (if any) the current thread is
+static thread_local JobSystem *t_owner = nullptr;
+static thread_local int t_workerIndex = -1;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Job::Job()
+    : work(), onComplete(), handle(), continuation(nullptr), submitTimeNs(0)
+{}
+
+WorkStealingQueue::WorkStealingQueue()
+    : m_jobs(), m_top(0), m_bottom(0)
+{
+    for(std::atomic<Job*> &j : m_jobs) {
+        j.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+bool WorkStealingQueue::push(Job *job) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+        return false;
+    }
+    m_jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    // Publish the job before thieves can see the new bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingQueue::pop() {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Empty; restore bottom
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Job *job = m_jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // Last job; race against any thief for it
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingQueue::steal() {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+        return nullptr;
+    }
+    Job *job = m_jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        // Lost to the owner or another thief
+        return nullptr;
+    }
+    return job;
+}
+
+bool WorkStealingQueue::empty() const {
+    return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+}
+
+uint64_t JobStats::latencyPercentileUs(float p) const {
+    uint64_t total = 0;
+    for(uint64_t n : latencyHistogram) {
+        total += n;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(p * total);
+    uint64_t seen = 0;
+    for(unsigned int i = 0; i < latencyHistogram.size(); ++i) {
+        seen += latencyHistogram[i];
+        if (seen > target || seen == total) {
+            return uint64_t(1) << i;
+        }
+    }
+    return uint64_t(1) << (latencyHistogram.size() - 1);
+}
+
+JobSystem::JobSystem(int threadCount)
+    : m_threads(), m_queues(), m_injectMtx(), m_injected(),
+      m_sleepMtx(), m_wake(), m_pending(0), m_stopping(false),
+      m_poolMtx(), m_jobStorage(), m_freeJobs(),
+      m_completeMtx(), m_completions(),
+      m_submitted(0), m_executed(0), m_stolen(0), m_poolAllocations(0),
+      m_latencyHistogram()
+{
+    for(std::atomic<uint64_t> &n : m_latencyHistogram) {
+        n.store(0);
+    }
+    if (threadCount <= 0) {
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+    for(int i = 0; i < threadCount; ++i) {
+        m_queues.push_back(mkU<WorkStealingQueue>());
+    }
+    // Start the threads only once every queue exists, since they steal
+    // from each other straight away
+    for(int i = 0; i < threadCount; ++i) {
+        m_threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    shutdown();
+}
+
+Job* JobSystem::create(std::function<void()> work, std::function<void()> onComplete, JobHandle handle) {
+    Job *job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_poolMtx);
+        if (m_freeJobs.empty()) {
+            m_jobStorage.push_back(mkU<Job>());
+            job = m_jobStorage.back().get();
+            m_poolAllocations.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            job = m_freeJobs.back();
+            m_freeJobs.pop_back();
+        }
+    }
+    job->work = std::move(work);
+    job->onComplete = std::move(onComplete);
+    job->handle = handle;
+    job->continuation = nullptr;
+    return job;
+}
+
+void JobSystem::setContinuation(Job *job, Job *next) {
+    job->continuation = next;
+}
+
+void JobSystem::submit(Job *job) {
+    m_submitted.fetch_add(1, std::memory_order_relaxed);
+    enqueue(job);
+}
+
+void JobSystem::enqueue(Job *job) {
+    job->submitTimeNs = nowNs();
+    // Workers keep their own follow-up work local; everyone else, or a
+    // worker whose deque is full, goes through the injection queue
+    bool pushed = false;
+    if (t_owner == this && t_workerIndex >= 0) {
+        pushed = m_queues[t_workerIndex]->push(job);
+    }
+    if (!pushed) {
+        std::lock_guard<std::mutex> lock(m_injectMtx);
+        m_injected.push_back(job);
+    }
+    m_pending.fetch_add(1, std::memory_order_release);
+    // Taking the lock, even briefly, means a worker can't miss this
+    // between checking m_pending and going to sleep
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMtx);
+    }
+    m_wake.notify_one();
+}
+
+Job* JobSystem::findJob(int index) {
+    Job *job = m_queues[index]->pop();
+    if (job == nullptr) {
+        std::lock_guard<std::mutex> lock(m_injectMtx);
+        if (!m_injected.empty()) {
+            job = m_injected.front();
+            m_injected.pop_front();
+        }
+    }
+    if (job == nullptr) {
+        int count = static_cast<int>(m_queues.size());
+        for(int i = 1; i < count && job == nullptr; ++i) {
+            job = m_queues[(index + i) % count]->steal();
+        }
+        if (job != nullptr) {
+            m_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (job != nullptr) {
+        m_pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return job;
+}
+
+void JobSystem::workerLoop(int index) {
+    t_owner = this;
+    t_workerIndex = index;
+    while(!m_stopping.load(std::memory_order_acquire)) {
+        Job *job = findJob(index);
+        if (job != nullptr) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMtx);
+        m_wake.wait(lock, [this]() {
+            return m_stopping.load(std::memory_order_acquire) || m_pending.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
+
+void JobSystem::execute(Job *job) {
+    int64_t waitedUs = (nowNs() - job->submitTimeNs) / 1000;
+    unsigned int bucket = 0;
+    while(bucket < m_latencyHistogram.size() - 1 && (int64_t(1) << bucket) <= waitedUs) {
+        ++bucket;
+    }
+    m_latencyHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if (!job->handle.isCancelled() && job->work) {
+        job->work();
+    }
+    m_executed.fetch_add(1, std::memory_order_relaxed);
+
+    if (job->continuation != nullptr) {
+        enqueue(job->continuation);
+    }
+    if (job->onComplete) {
+        std::lock_guard<std::mutex> lock(m_completeMtx);
+        m_completions.push_back(std::move(job->onComplete));
+    }
+    release(job);
+}
+
+void JobSystem::release(Job *job) {
+    // Drop any captured state now rather than when the job is reused
+    job->work = std::function<void()>();
+    job->onComplete = std::function<void()>();
+    job->handle = JobHandle();
+    job->continuation = nullptr;
+    std::lock_guard<std::mutex> lock(m_poolMtx);
+    m_freeJobs.push_back(job);
+}
+
+int JobSystem::runCompletions() {
+    std::vector< std::function<void()> > completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completeMtx);
+        completions.swap(m_completions);
+    }
+    for(std::function<void()> &f : completions) {
+        f();
+    }
+    return static_cast<int>(completions.size());
+}
+
+void JobSystem::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMtx);
+        m_stopping.store(true, std::memory_order_release);
+    }
+    m_wake.notify_all();
+    for(std::thread &t : m_threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    m_threads.clear();
+
+    // Let go of whatever the jobs that never ran, and the callbacks that
+    // never will, captured, while what it refers to still exists
+    std::vector<Job*> dropped;
+    for(uPtr<WorkStealingQueue> &q : m_queues) {
+        while (Job *job = q->pop()) {
+            dropped.push_back(job);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_injectMtx);
+        dropped.insert(dropped.end(), m_injected.begin(), m_injected.end());
+        m_injected.clear();
+    }
+    for(size_t i = 0; i < dropped.size(); ++i) {
+        if (dropped[i]->continuation != nullptr) {
+            dropped.push_back(dropped[i]->continuation);
+        }
+        release(dropped[i]);
+    }
+    std::lock_guard<std::mutex> lock(m_completeMtx);
+    m_completions.clear();
+}
+
+int JobSystem::threadCount() const {
+    return static_cast<int>(m_queues.size());
+}
+
+JobStats JobSystem::stats() const {
+    JobStats s;
+    s.submitted = m_submitted.load();
+    s.executed = m_executed.load();
+    s.stolen = m_stolen.load();
+    s.poolAllocations = m_poolAllocations.load();
+    for(unsigned int i = 0; i < s.latencyHistogram.size(); ++i) {
+        s.latencyHistogram[i] = m_latencyHistogram[i].load();
+    }
+    return s;
+}
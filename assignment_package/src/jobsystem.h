@@ -0,0 +1,133 @@
+#pragma once
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include "smartpointerhelp.h"
+#include "jobhandle.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One unit of work for the JobSystem. Jobs are handed out by
+// JobSystem::create() from a pool and returned to it once they
+// have run, so callers never allocate or free them directly.
+struct Job {
+    std::function<void()> work;       // Runs on a worker thread
+    std::function<void()> onComplete; // Runs on the main thread, in runCompletions()
+    JobHandle handle;                 // If cancelled before it starts, work is skipped
+    Job *continuation;                // Submitted from the worker once work has run
+    int64_t submitTimeNs;
+
+    Job();
+};
+
+// A fixed-capacity Chase-Lev work-stealing deque. Only the owning
+// worker may push() and pop() (both at the bottom); any thread may
+// steal() from the top.
+class WorkStealingQueue {
+private:
+    static const int CAPACITY = 4096; // Must be a power of two
+    std::array<std::atomic<Job*>, CAPACITY> m_jobs;
+    std::atomic<int64_t> m_top;
+    std::atomic<int64_t> m_bottom;
+
+public:
+    WorkStealingQueue();
+    // Returns false if the queue is full
+    bool push(Job *job);
+    Job* pop();
+    Job* steal();
+    bool empty() const;
+};
+
+// Timing counters for the jobs that have been run, used to compare
+// against QThreadPool. Latency is measured from submit() to the moment
+// a worker starts the job, bucketed by powers of two of microseconds.
+struct JobStats {
+    uint64_t submitted;
+    uint64_t executed;
+    uint64_t stolen;
+    uint64_t poolAllocations;  // Jobs that could not be served from the pool
+    std::array<uint64_t, 32> latencyHistogram;
+
+    // Upper bound, in microseconds, of the bucket holding the given percentile
+    uint64_t latencyPercentileUs(float p) const;
+};
+
+// A small job system with one work-stealing deque per worker thread.
+// Work submitted from a worker (e.g. a continuation) goes onto that
+// worker's own deque; work submitted from anywhere else goes through a
+// shared injection queue. Idle workers steal from each other before
+// going to sleep. Completion callbacks are queued up for the main thread,
+// so results can be consumed there without polling flags.
+class JobSystem {
+private:
+    std::vector<std::thread> m_threads;
+    std::vector< uPtr<WorkStealingQueue> > m_queues;
+
+    // Jobs submitted from outside the worker threads
+    std::mutex m_injectMtx;
+    std::deque<Job*> m_injected;
+
+    // Sleeping workers wait here until there is something to take
+    std::mutex m_sleepMtx;
+    std::condition_variable m_wake;
+    std::atomic<int> m_pending;
+    std::atomic<bool> m_stopping;
+
+    // Pool of reusable Job objects
+    std::mutex m_poolMtx;
+    std::vector< uPtr<Job> > m_jobStorage;
+    std::vector<Job*> m_freeJobs;
+
+    // Main-thread completion queue
+    std::mutex m_completeMtx;
+    std::vector< std::function<void()> > m_completions;
+
+    std::atomic<uint64_t> m_submitted;
+    std::atomic<uint64_t> m_executed;
+    std::atomic<uint64_t> m_stolen;
+    std::atomic<uint64_t> m_poolAllocations;
+    std::array<std::atomic<uint64_t>, 32> m_latencyHistogram;
+
+    void workerLoop(int index);
+    Job* findJob(int index);
+    void execute(Job *job);
+    void release(Job *job);
+    void enqueue(Job *job);
+
+public:
+    // Uses one worker per hardware thread, less one for the main thread,
+    // unless a thread count is given
+    JobSystem(int threadCount = 0);
+    ~JobSystem();
+
+    // Takes a job from the pool. It does nothing until it is submitted.
+    Job* create(std::function<void()> work,
+                std::function<void()> onComplete = std::function<void()>(),
+                JobHandle handle = JobHandle());
+    // Makes next run on a worker as soon as job has finished. next must
+    // not be submitted separately.
+    void setContinuation(Job *job, Job *next);
+    void submit(Job *job);
+
+    // Runs all completion callbacks that have been queued by finished jobs.
+    // Must be called from the main thread. Returns the number run.
+    int runCompletions();
+
+    // Stops the workers once their current job is done. Jobs that have not
+    // started yet are dropped without running their callbacks, and what
+    // they captured is released before this returns.
+    void shutdown();
+
+    int threadCount() const;
+    JobStats stats() const;
+};
+
+#endif // JOBSYSTEM_H
@@ -1,4 +1,5 @@
 #include <mainwindow.h>
+#include "jobbenchmark.h"
 
 #include <QApplication>
 #include <QSurfaceFormat>
@@ -24,6 +25,11 @@ int main(int argc, char *argv[])
     QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QApplication a(argc, argv);
 
+    if (qgetenv("MINIMINECRAFT_JOB_BENCHMARK") != nullptr) {
+        runJobBenchmark();
+        return 0;
+    }
+
     // Set OpenGL 3.2 and, optionally, 4-sample multisampling
     QSurfaceFormat format;
     format.setVersion(3, 2);
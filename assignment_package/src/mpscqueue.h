@@ -0,0 +1,189 @@
+#pragma once
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// Counters describing how a MPSCQueue has been used so far.
+// Residency is the time an item spent in the queue between push() and tryPop().
+struct MPSCQueueStats {
+    size_t depth;               // Items waiting right now
+    size_t maxDepth;            // Most items ever waiting at once
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t producerStalls;    // Pushes that found the queue full and had to wait
+    uint64_t producerStallNs;   // Total time producers spent waiting for space
+    uint64_t totalResidencyNs;
+    uint64_t maxResidencyNs;
+
+    float averageResidencyMs() const {
+        return popped == 0 ? 0.f : totalResidencyNs / (popped * 1000000.f);
+    }
+};
+
+// A bounded, lock-free multi-producer / single-consumer queue
+// (after Dmitry Vyukov's bounded MPMC queue). Each cell carries a
+// sequence number that tells producers and the consumer whose turn it is,
+// so neither side ever takes a lock. Any number of threads may push();
+// only one thread may call tryPop().
+// Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class MPSCQueue {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "MPSCQueue capacity must be a power of two");
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int64_t pushTimeNs;
+        T data;
+    };
+
+    std::array<Cell, Capacity> m_cells;
+    // Kept on separate cache lines so producers and the consumer
+    // don't invalidate each other's position on every operation
+    alignas(64) std::atomic<size_t> m_enqueuePos;
+    alignas(64) std::atomic<size_t> m_dequeuePos;
+
+    std::atomic<bool> m_closed;
+    std::atomic<size_t> m_maxDepth;
+    // Items actually published; m_enqueuePos also counts cells
+    // claimed by producers that haven't finished writing them
+    std::atomic<uint64_t> m_pushed;
+    std::atomic<uint64_t> m_producerStalls;
+    std::atomic<uint64_t> m_producerStallNs;
+    // Only written by the consumer
+    uint64_t m_popped;
+    uint64_t m_totalResidencyNs;
+    uint64_t m_maxResidencyNs;
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    MPSCQueue()
+        : m_cells(), m_enqueuePos(0), m_dequeuePos(0), m_closed(false), m_maxDepth(0),
+          m_pushed(0), m_producerStalls(0), m_producerStallNs(0),
+          m_popped(0), m_totalResidencyNs(0), m_maxResidencyNs(0)
+    {
+        for(size_t i = 0; i < Capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            m_cells[i].pushTimeNs = 0;
+        }
+    }
+
+    // Returns false without blocking if the queue is full
+    bool tryPush(T &&item) {
+        Cell *cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &m_cells[pos & (Capacity - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // The cell is free; claim it
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The consumer hasn't got to this cell yet
+                return false;
+            } else {
+                // Another producer got here first
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->pushTimeNs = nowNs();
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+        // The consumer may already have popped this cell and others after
+        // it, which would make the unsigned difference wrap
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+        if (dequeuePos <= pos + 1) {
+            size_t depth = pos + 1 - dequeuePos;
+            size_t maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+            while(depth > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed)) {}
+        }
+        return true;
+    }
+
+    // Pushes the item, yielding until there is room if the queue is full.
+    // Only producers ever wait; the consumer never does. Returns false,
+    // leaving item as it was, if the queue is closed while waiting.
+    bool push(T &&item) {
+        if (tryPush(std::move(item))) {
+            return true;
+        }
+        int64_t start = nowNs();
+        bool pushed;
+        do {
+            std::this_thread::yield();
+            pushed = tryPush(std::move(item));
+        } while(!pushed && !m_closed.load(std::memory_order_acquire));
+        m_producerStalls.fetch_add(1, std::memory_order_relaxed);
+        m_producerStallNs.fetch_add(nowNs() - start, std::memory_order_relaxed);
+        return pushed;
+    }
+
+    // Lets every producer waiting in push(), and any that waits later,
+    // give up instead. For shutdown, once the consumer has stopped popping.
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    // Consumer only. Returns false without blocking if nothing is ready.
+    bool tryPop(T &out) {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell *cell = &m_cells[pos & (Capacity - 1)];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) {
+            return false;
+        }
+        out = std::move(cell->data);
+        uint64_t residency = static_cast<uint64_t>(nowNs() - cell->pushTimeNs);
+        // Hand the cell back to producers for the next lap
+        cell->sequence.store(pos + Capacity, std::memory_order_release);
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+        ++m_popped;
+        m_totalResidencyNs += residency;
+        if (residency > m_maxResidencyNs) {
+            m_maxResidencyNs = residency;
+        }
+        return true;
+    }
+
+    // Approximate when called while producers are active
+    size_t depth() const {
+        // Read the consumer's position first: it never passes the
+        // producers', so the difference can't wrap
+        size_t dequeuePos = m_dequeuePos.load(std::memory_order_relaxed);
+        size_t enqueuePos = m_enqueuePos.load(std::memory_order_relaxed);
+        return enqueuePos >= dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    // Consumer only, since the residency counters belong to it
+    MPSCQueueStats stats() const {
+        MPSCQueueStats s;
+        s.depth = depth();
+        s.maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+        s.pushed = m_pushed.load(std::memory_order_relaxed);
+        s.popped = m_popped;
+        s.producerStalls = m_producerStalls.load(std::memory_order_relaxed);
+        s.producerStallNs = m_producerStallNs.load(std::memory_order_relaxed);
+        s.totalResidencyNs = m_totalResidencyNs;
+        s.maxResidencyNs = m_maxResidencyNs;
+        return s;
+    }
+};
+
+#endif // MPSCQUEUE_H
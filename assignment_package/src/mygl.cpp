@@ -2,6 +2,7 @@
 #include <glm_includes.h>
 
 #include <iostream>
+#include <chrono>
 #include <QApplication>
 #include <QKeyEvent>
 
@@ -10,15 +11,20 @@ MyGL::MyGL(QWidget *parent)
     : OpenGLContext(parent),
       m_worldAxes(this),
       m_progLambert(this), m_progFlat(this),
-      skyBox(this), m_progSky(this),
+      skyBox(this), m_progSky(this), m_progSkyBake(this), m_skyCache(this),
       m_terrain(this), m_player(glm::vec3(48.f, 140.f, 48.f), m_terrain),
-      lastFrame(QDateTime::currentMSecsSinceEpoch()),
-      m_texture(this), m_time(0.f)
+      m_loop(), m_prevEye(m_player.mcr_camera.mcr_position), m_currEye(m_prevEye),
+      m_printStats(qgetenv("MINIMINECRAFT_STATS") != nullptr), lastStatsReport(QDateTime::currentMSecsSinceEpoch()),
+      m_paintMsTotal(0.f), m_paintMsMax(0.f), m_paintCount(0),
+      m_texture(this), m_time(0.f),
+      m_frameUniforms(this), m_renderQueue(this)
 {
-    // Connect the timer to a function so that when the timer ticks the function is executed
-    connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
-    // Tell the timer to redraw 60 times per second
-    m_timer.start(16);
+    // Each frame starts the next one as soon as it has been swapped, so
+    // frames are paced by the display rather than by a timer
+    connect(this, SIGNAL(frameSwapped()), this, SLOT(tick()));
+    // Only there to get frames going again if one is ever skipped
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(update()));
+    m_timer.start(100);
     setFocusPolicy(Qt::ClickFocus);
 
     setMouseTracking(true); // MyGL will track the mouse's movements even if a mouse button is not pressed
@@ -28,6 +34,8 @@ MyGL::MyGL(QWidget *parent)
 MyGL::~MyGL() {
     makeCurrent();
     glDeleteVertexArrays(1, &vao);
+    m_frameUniforms.destroy();
+    m_skyCache.destroy();
 }
 
 
@@ -40,6 +48,11 @@ void MyGL::initializeGL()
     // Create an OpenGL context using Qt's QOpenGLFunctions_3_2_Core class
     // If you were programming in a non-Qt context you might use GLEW (GL Extension Wrangler)instead
     initializeOpenGLFunctions();
+    // Called again whenever the context is recreated. The programs made
+    // below have none of the model matrices the queue remembers, and
+    // nothing is bound yet, though the new ids may match the old ones.
+    m_renderQueue.invalidate();
+    m_boundProgram = 0;
     // Print out some information about the current OpenGL context
     debugContextVersion();
 
@@ -58,12 +71,18 @@ void MyGL::initializeGL()
     //Create the instance of the world axes
     m_worldAxes.create();
 
+    // Every program reads the camera and time from this
+    m_frameUniforms.create();
+
     // Create and set up the diffuse shader
     m_progLambert.create(":/glsl/lambert.vert.glsl", ":/glsl/lambert.frag.glsl");
     // Create and set up the flat lighting shader
     m_progFlat.create(":/glsl/flat.vert.glsl", ":/glsl/flat.frag.glsl");
     // Create and set up sky shader
     m_progSky.create(":/glsl/skycycle.vert.glsl", ":/glsl/skycycle.frag.glsl");
+    m_progSkyBake.create(":/glsl/skycycle.vert.glsl", ":/glsl/skybake.frag.glsl");
+    m_progSky.useMe();
+    glUniform1i(glGetUniformLocation(m_progSky.prog, "u_SkyCube"), SKY_TEXTURE_SLOT);
 
     // Set a color with which to draw geometry.
     // This will ultimately not be used when you change
@@ -83,6 +102,9 @@ void MyGL::initializeGL()
 
     // Test scene no longer needed; delete later
     skyBox.create();
+    m_skyCache.create(&m_progSkyBake);
+    // Edited chunks are kept here between runs
+    m_terrain.openWorld("saves/world");
     m_terrain.CreateTestScene();
 }
 
@@ -90,33 +112,64 @@ void MyGL::resizeGL(int w, int h) {
     //This code sets the concatenated view and perspective projection matrices used for
     //our scene's camera view.
     m_player.setCameraWidthHeight(static_cast<unsigned int>(w), static_cast<unsigned int>(h));
-    glm::mat4 viewproj = m_player.mcr_camera.getViewProj();
-
-    // Upload the view-projection matrix to our shaders (i.e. onto the graphics card)
-    m_progLambert.setViewProjMatrix(viewproj);
-    m_progFlat.setViewProjMatrix(viewproj);
-    m_progSky.setViewProjMatrix(glm::inverse(viewproj));
-    m_progSky.useMe();
-    this->glUniform2i(m_progSky.unifDimensions, width() * devicePixelRatio(), height() * devicePixelRatio());
-    this->glUniform3f(m_progSky.unifEye, m_player.mcr_camera.mcr_position.x,
-                      m_player.mcr_camera.mcr_position.y, m_player.mcr_camera.mcr_position.z);
+    // The new projection and screen size reach the shaders
+    // through the frame uniforms in the next paintGL()
 
     printGLErrorLog();
 }
 
 
-// MyGL's constructor links tick() to a timer that fires 60 times per second.
-// We're treating MyGL as our game engine class, so we're going to perform
-// all per-frame actions here, such as performing physics updates on all
-// entities in the scene.
+// MyGL's constructor links tick() to frameSwapped(), so this runs once
+// per frame. We're treating MyGL as our game engine class, so we're going
+// to perform all per-frame actions here. Physics runs in fixed steps of
+// GameLoop::TICK_MS, however long the frame took; looking around and
+// streaming run once a frame.
 void MyGL::tick() {
+    int ticks = m_loop.beginFrame();
+    // Before the ticks, so they move the player the way it now faces
+    m_player.updateLook(m_inputs);
+    for(int i = 0; i < ticks; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        m_prevEye = m_player.mcr_camera.mcr_position;
+        m_player.tick(GameLoop::TICK_MS, m_inputs);
+        m_currEye = m_player.mcr_camera.mcr_position;
+        m_time++;
+        m_loop.recordTick(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
     m_terrain.expandChunks(m_player); // Checks if more chunks need to be loaded
     m_terrain.updateChunks(); // Move thread generated chunks to terrain
+    m_terrain.evictChunks(); // Unload zones the player has left far behind
+    m_terrain.persistEdits(); // Checkpoint once the edit journal has grown long
+    m_terrain.freezeIdleChunks(); // Pack the blocks of chunks nobody has touched in a while
     m_terrain.updateVBOs();
     update(); // Calls paintGL() as part of a larger QOpenGLWidget pipeline
     long long currframe = QDateTime::currentMSecsSinceEpoch();
-    m_player.tick(currframe - lastFrame, m_inputs);
-    lastFrame = currframe;
+    if (m_printStats && currframe - lastStatsReport >= STATS_INTERVAL_MS) {
+        m_terrain.printStats(std::cout);
+        if (m_paintCount > 0) {
+            std::cout << "  paintGL CPU: " << m_paintMsTotal / m_paintCount << " ms avg, "
+                      << m_paintMsMax << " ms max over " << m_paintCount << " frames" << std::endl;
+        }
+        RenderQueueStats rq = m_renderQueue.stats();
+        std::cout << "  render queue: " << rq.items << " items, " << rq.programChanges << " program binds, "
+                  << rq.textureChanges << " texture binds, " << rq.modelUploads << " model uploads last frame" << std::endl;
+        std::cout << "  sky: cubemap baked " << m_skyCache.refreshCount() << " times" << std::endl;
+        const TimeHistogram &frames = m_loop.frameTimes();
+        const TimeHistogram &tickTimes = m_loop.tickTimes();
+        std::cout << "  frame interval: " << frames.averageMs() << " ms avg, p50 " << frames.percentileMs(0.5f)
+                  << " ms, p99 " << frames.percentileMs(0.99f) << " ms, max " << frames.maxMs << " ms;";
+        frames.print(std::cout);
+        std::cout << std::endl;
+        std::cout << "  ticks: " << m_loop.tickCount() << " run, " << m_loop.droppedMs() << " ms dropped, CPU "
+                  << tickTimes.averageMs() << " ms avg, p99 " << tickTimes.percentileMs(0.99f) << " ms, max "
+                  << tickTimes.maxMs << " ms;";
+        tickTimes.print(std::cout);
+        std::cout << std::endl;
+        m_loop.clearHistograms();
+        m_paintMsTotal = m_paintMsMax = 0.f;
+        m_paintCount = 0;
+        lastStatsReport = currframe;
+    }
     sendPlayerDataToGUI(); // Updates the info in the secondary window displaying player data
 }
 
@@ -132,49 +185,55 @@ void MyGL::sendPlayerDataToGUI() const {
     emit sig_sendPlayerTerrainZone(QString::fromStdString("( " + std::to_string(zone.x) + ", " + std::to_string(zone.y) + " )"));
 }
 
-// This function is called whenever update() is called.
-// MyGL's constructor links update() to a timer that fires 60 times per second,
-// so paintGL() called at a rate of 60 frames per second.
+// This function is called whenever update() is called, which tick()
+// does once per frame, so paintGL() runs at the display's refresh rate.
 void MyGL::paintGL() {
+    auto start = std::chrono::steady_clock::now();
     // Clear the screen so that we only see newly drawn images
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    m_progFlat.setViewProjMatrix(m_player.mcr_camera.getViewProj());
-    m_progLambert.setViewProjMatrix(m_player.mcr_camera.getViewProj());
-
-//    m_progSky.setEye(m_player.mcr_camera.mcr_position);
-//    m_progSky.setTime(m_time);
-//    m_progSky.setDimensions(width() * devicePixelRatio(), height() * devicePixelRatio());
-
-    m_progSky.setViewProjMatrix(glm::inverse(m_player.mcr_camera.getViewProj()));
-    m_progSky.useMe();
-    this->glUniform3f(m_progSky.unifEye, m_player.mcr_camera.mcr_position.x,
-                      m_player.mcr_camera.mcr_position.y, m_player.mcr_camera.mcr_position.z);
-    this->glUniform1f(m_progSky.unifTime, m_time);
-    m_progSky.draw(skyBox);
+    // Draw from between the last two simulation steps, so motion is smooth
+    // even when frames and ticks don't line up. The view direction is
+    // always the latest, since tick() applies the mouse every frame.
+    float alpha = m_loop.alpha();
+    Camera camera(m_player.mcr_camera);
+    camera.moveAlongVector(glm::mix(m_prevEye, m_currEye, alpha) - camera.mcr_position);
+
+    FrameUniforms frame;
+    frame.viewProj = camera.getViewProj();
+    frame.invViewProj = glm::inverse(frame.viewProj);
+    frame.eye = camera.mcr_position;
+    frame.time = m_time + alpha;
+    frame.dimensions = glm::ivec2(width() * devicePixelRatio(), height() * devicePixelRatio());
+    m_frameUniforms.update(frame);
+    if (m_skyCache.needsRefresh(frame.time)) {
+        m_skyCache.refresh(skyBox, frame.time);
+    }
 
-    m_texture.bind(0);
-    m_terrain.setTime(m_time);
-    m_time++;
+    m_renderQueue.submit(PASS_SKY, &m_progSky, nullptr, skyBox, glm::mat4());
+    renderTerrain(camera);
+    m_renderQueue.submit(PASS_OVERLAY, &m_progFlat, nullptr, m_worldAxes, glm::mat4());
+    m_renderQueue.flush();
 
-    renderTerrain();
+    glBindVertexArray(vao);
 
-    glDisable(GL_DEPTH_TEST);
-    m_progFlat.setModelMatrix(glm::mat4());
-    m_progFlat.setViewProjMatrix(m_player.mcr_camera.getViewProj());
-    m_progFlat.draw(m_worldAxes);
-    glEnable(GL_DEPTH_TEST);
+    // CPU side only; the GPU may still be working through the frame
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_paintMsTotal += ms;
+    m_paintMsMax = std::max(m_paintMsMax, ms);
+    ++m_paintCount;
 }
 
 // Renders the nine zones of generated
 // terrain that surround the player (refer to Terrain::m_generatedTerrain
 // for more info)
-void MyGL::renderTerrain() {
+void MyGL::renderTerrain(const Camera &camera) {
     // Get the zone that the player is currently in
     int player_x = static_cast<int>(glm::floor(m_player.mcr_position[0] / 64.f) * 64);
     int player_z = static_cast<int>(glm::floor(m_player.mcr_position[2] / 64.f) * 64);
     // Just draw it all at once; 3x3 terrain generation zone around the player
-    m_terrain.draw(player_x - 64, player_x + 128, player_z - 64, player_z + 128, &m_progLambert);
+    m_terrain.draw(player_x - 64, player_x + 128, player_z - 64, player_z + 128,
+                   camera, &m_progLambert, &m_texture, m_renderQueue);
 }
 
 
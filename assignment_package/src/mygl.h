@@ -8,12 +8,16 @@
 #include "scene/terrain.h"
 #include "scene/player.h"
 #include "scene/sky.h"
+#include "scene/skycache.h"
 
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <smartpointerhelp.h>
 #include <QDateTime>
 #include "texture.h"
+#include "uniformbuffer.h"
+#include "renderqueue.h"
+#include "gameloop.h"
 
 
 
@@ -26,20 +30,41 @@ private:
     ShaderProgram m_progFlat;// A shader program that uses "flat" reflection (no shadowing at all)
     Sky skyBox;
     ShaderProgram m_progSky; //shader program for skybox
+    ShaderProgram m_progSkyBake; // Renders the sky into m_skyCache
+    SkyCache m_skyCache;
 
-    GLuint vao; // A handle for our vertex array object. This will store the VBOs created in our geometry classes.
-    // Don't worry too much about this. Just know it is necessary in order to render geometry.
+    GLuint vao; // A default vertex array object, bound whenever nothing is being drawn. Every Drawable and
+    // GeometryArena has its own VAO for drawing, so buffer setup between frames never lands in one of those.
 
     Terrain m_terrain; // All of the Chunks that currently comprise the world.
     Player m_player; // The entity controlled by the user. Contains a camera to display what it sees as well.
     InputBundle m_inputs; // A collection of variables to be updated in keyPressEvent, mouseMoveEvent, mousePressEvent, etc.
 
-    QTimer m_timer; // Timer linked to tick(). Fires approximately 60 times per second.
-    long long lastFrame;
+    QTimer m_timer; // Requests a frame every so often in case the frameSwapped() chain is ever broken
+    // Fixed-rate simulation; tick() asks it how many steps to run each frame
+    GameLoop m_loop;
+    // Where the camera was before and after the last simulation step;
+    // frames are drawn from a point between the two
+    glm::vec3 m_prevEye;
+    glm::vec3 m_currEye;
+    // When MINIMINECRAFT_STATS is set, Terrain's streaming
+    // counters are printed every STATS_INTERVAL_MS
+    bool m_printStats;
+    long long lastStatsReport;
+    static const int STATS_INTERVAL_MS = 5000;
+    // CPU time spent in paintGL() since the last stats report
+    float m_paintMsTotal;
+    float m_paintMsMax;
+    int m_paintCount;
 
     Texture m_texture;
     int m_time;
 
+    // Camera, time and screen size, uploaded once per frame for every program
+    FrameUniformBuffer m_frameUniforms;
+    // Everything drawn in paintGL() goes through here
+    RenderQueue m_renderQueue;
+
     void moveMouseToCenter(); // Forces the mouse position to the screen's center. You should call this
     // from within a mouse move event after reading the mouse movement so that
     // your mouse stays within the screen bounds and is always read.
@@ -64,7 +89,7 @@ public:
 
     // Called from paintGL().
     // Calls Terrain::draw().
-    void renderTerrain();
+    void renderTerrain(const Camera &camera);
 
 protected:
     // Automatically invoked when the user
@@ -80,7 +105,7 @@ protected:
     void mouseReleaseEvent(QMouseEvent *e);
 
 private slots:
-    void tick(); // Slot that gets called ~60 times per second by m_timer firing.
+    void tick(); // Slot that runs once per frame, after the previous one has been swapped to the screen.
 
 signals:
     void sig_sendPlayerPos(QString) const;
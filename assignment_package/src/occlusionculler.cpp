@@ -0,0 +1,179 @@
+#include "occlusionculler.h"
+#include <algorithm>
+
+// Clip-space w below which a vertex is treated as
+// being behind the near plane
+static const float MIN_W = 1e-3f;
+
+OcclusionCuller::OcclusionCuller()
+    : m_levels(), m_levelSizes(), m_viewProj()
+{
+    glm::ivec2 size(WIDTH, HEIGHT);
+    for(;;) {
+        m_levelSizes.push_back(size);
+        m_levels.push_back(std::vector<float>(size.x * size.y, 1.f));
+        if (size.x == 1 && size.y == 1) {
+            break;
+        }
+        size = glm::max(size / 2, glm::ivec2(1));
+    }
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProj) {
+    m_viewProj = viewProj;
+    std::fill(m_levels[0].begin(), m_levels[0].end(), 1.f);
+}
+
+void OcclusionCuller::rasterizeOccluder(const AABB &box) {
+    glm::vec4 corners[8];
+    for(int i = 0; i < 8; ++i) {
+        glm::vec3 p((i & 1) ? box.max.x : box.min.x,
+                    (i & 2) ? box.max.y : box.min.y,
+                    (i & 4) ? box.max.z : box.min.z);
+        corners[i] = m_viewProj * glm::vec4(p, 1.f);
+    }
+    // Each face as one quad, indexed by the corner bits above. Splitting
+    // them into triangles would leave the texels along the diagonal
+    // covered by neither half.
+    static const int faces[6][4] = {
+        {0, 2, 6, 4}, {1, 5, 7, 3}, // -X, +X
+        {0, 4, 5, 1}, {2, 3, 7, 6}, // -Y, +Y
+        {0, 1, 3, 2}, {4, 6, 7, 5}  // -Z, +Z
+    };
+    for(const auto &f : faces) {
+        rasterizeQuad({corners[f[0]], corners[f[1]], corners[f[2]], corners[f[3]]});
+    }
+}
+
+static float edge(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &p) {
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+void OcclusionCuller::rasterizeQuad(std::array<glm::vec4, 4> clip) {
+    // Clipping is skipped: a face crossing the near plane is simply
+    // not used as an occluder, which can only make culling less aggressive
+    for(const glm::vec4 &v : clip) {
+        if (v.w < MIN_W) {
+            return;
+        }
+    }
+    std::array<glm::vec2, 4> s;
+    float depth = -1.f;
+    for(int i = 0; i < 4; ++i) {
+        glm::vec3 ndc = glm::vec3(clip[i]) / clip[i].w;
+        s[i] = glm::vec2((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+        depth = std::max(depth, ndc.z);
+    }
+    if (depth >= 1.f) {
+        return;
+    }
+    // A planar face that doesn't cross the near plane projects to a
+    // convex quad; faces seen edge on cover nothing
+    float area = edge(s[0], s[1], s[2]) + edge(s[0], s[2], s[3]);
+    if (glm::abs(area) < 1e-6f) {
+        return;
+    }
+    // Either winding is fine; flip so the edge tests are all >= 0 inside
+    if (area < 0.f) {
+        std::swap(s[1], s[3]);
+    }
+
+    glm::vec2 lo = glm::min(glm::min(s[0], s[1]), glm::min(s[2], s[3]));
+    glm::vec2 hi = glm::max(glm::max(s[0], s[1]), glm::max(s[2], s[3]));
+    int x0 = std::max(0, static_cast<int>(glm::floor(lo.x)));
+    int y0 = std::max(0, static_cast<int>(glm::floor(lo.y)));
+    int x1 = std::min(WIDTH - 1, static_cast<int>(glm::ceil(hi.x)));
+    int y1 = std::min(HEIGHT - 1, static_cast<int>(glm::ceil(hi.y)));
+
+    // Only texels the quad covers completely are written, so an edge
+    // never claims more of the screen than the occluder really hides.
+    // The quad is convex, so that is when all four corners are inside.
+    auto inside = [&s](const glm::vec2 &p) {
+        return edge(s[0], s[1], p) >= 0.f && edge(s[1], s[2], p) >= 0.f
+                && edge(s[2], s[3], p) >= 0.f && edge(s[3], s[0], p) >= 0.f;
+    };
+    std::vector<float> &buf = m_levels[0];
+    for(int y = y0; y <= y1; ++y) {
+        for(int x = x0; x <= x1; ++x) {
+            glm::vec2 p(x, y);
+            if (inside(p) && inside(p + glm::vec2(1.f, 0.f))
+                    && inside(p + glm::vec2(0.f, 1.f)) && inside(p + glm::vec2(1.f, 1.f))) {
+                float &d = buf[y * WIDTH + x];
+                d = std::min(d, depth);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid() {
+    for(size_t l = 1; l < m_levels.size(); ++l) {
+        const std::vector<float> &src = m_levels[l - 1];
+        glm::ivec2 srcSize = m_levelSizes[l - 1];
+        glm::ivec2 size = m_levelSizes[l];
+        std::vector<float> &dst = m_levels[l];
+        for(int y = 0; y < size.y; ++y) {
+            for(int x = 0; x < size.x; ++x) {
+                // Odd sizes fold their last row or column into the last texel
+                int sx0 = std::min(2 * x, srcSize.x - 1), sx1 = std::min(2 * x + 1, srcSize.x - 1);
+                int sy0 = std::min(2 * y, srcSize.y - 1), sy1 = std::min(2 * y + 1, srcSize.y - 1);
+                dst[y * size.x + x] = std::max(std::max(src[sy0 * srcSize.x + sx0], src[sy0 * srcSize.x + sx1]),
+                                               std::max(src[sy1 * srcSize.x + sx0], src[sy1 * srcSize.x + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const AABB &box) const {
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    float nearest = 1.f;
+    for(int i = 0; i < 8; ++i) {
+        glm::vec3 p((i & 1) ? box.max.x : box.min.x,
+                    (i & 2) ? box.max.y : box.min.y,
+                    (i & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = m_viewProj * glm::vec4(p, 1.f);
+        if (clip.w < MIN_W) {
+            return true;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 screen((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+        lo = glm::min(lo, screen);
+        hi = glm::max(hi, screen);
+        nearest = std::min(nearest, ndc.z);
+    }
+    // Nothing is known about what lies past the edges of the buffer,
+    // so a box reaching past them can't be proven hidden. This is also
+    // what keeps a result sound after the camera turns a little.
+    if (lo.x < 0.f || lo.y < 0.f || hi.x > WIDTH || hi.y > HEIGHT) {
+        return true;
+    }
+    int x0 = static_cast<int>(glm::floor(lo.x));
+    int y0 = static_cast<int>(glm::floor(lo.y));
+    int x1 = std::min(WIDTH - 1, static_cast<int>(glm::floor(hi.x)));
+    int y1 = std::min(HEIGHT - 1, static_cast<int>(glm::floor(hi.y)));
+    // The finest level where the box covers at most 2 x 2 texels
+    int level = 0;
+    while (level + 1 < levelCount() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        ++level;
+    }
+    glm::ivec2 size = m_levelSizes[level];
+    for(int y = std::min(y0 >> level, size.y - 1); y <= std::min(y1 >> level, size.y - 1); ++y) {
+        for(int x = std::min(x0 >> level, size.x - 1); x <= std::min(x1 >> level, size.x - 1); ++x) {
+            if (nearest <= m_levels[level][y * size.x + x]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int OcclusionCuller::levelCount() const {
+    return static_cast<int>(m_levels.size());
+}
+
+glm::ivec2 OcclusionCuller::levelSize(int level) const {
+    return m_levelSizes[level];
+}
+
+float OcclusionCuller::depthAt(int level, int x, int y) const {
+    return m_levels[level][y * m_levelSizes[level].x + x];
+}
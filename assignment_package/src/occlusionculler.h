@@ -0,0 +1,53 @@
+#pragma once
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "glm_includes.h"
+#include "frustum.h"
+#include <array>
+#include <vector>
+
+// A small software depth buffer for occlusion culling, entirely on the
+// CPU so it can run on a worker thread and needs no GL context.
+//
+// Occluders are boxes known to be completely solid. Each of their
+// faces is written only to the texels it covers completely, at the
+// depth of its furthest corner, so the buffer never claims anything is
+// covered, or closer, than it really is. Once every occluder is in, a
+// max-depth pyramid is built, and a box is hidden if it lies within the
+// buffer and its nearest point is behind the furthest depth everywhere
+// it covers.
+// Depths are NDC z, with 1 (the far plane) meaning nothing was drawn.
+class OcclusionCuller {
+public:
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 128;
+
+private:
+    // Level 0 is the full-resolution buffer; each level after it
+    // holds the furthest depth of 2 x 2 texels of the one before
+    std::vector< std::vector<float> > m_levels;
+    std::vector<glm::ivec2> m_levelSizes;
+    glm::mat4 m_viewProj;
+
+    // Takes the four corners of a box face in clip space, in order
+    void rasterizeQuad(std::array<glm::vec4, 4> clip);
+
+public:
+    OcclusionCuller();
+
+    // Clears the depth buffer for a new view
+    void begin(const glm::mat4 &viewProj);
+    void rasterizeOccluder(const AABB &box);
+    // Call once every occluder has been rasterized, before any isVisible()
+    void buildPyramid();
+    // Conservative: anything that straddles the near plane or the edges
+    // of the screen, or that can't be proven hidden, is visible
+    bool isVisible(const AABB &box) const;
+
+    int levelCount() const;
+    glm::ivec2 levelSize(int level) const;
+    float depthAt(int level, int x, int y) const;
+};
+
+#endif // OCCLUSIONCULLER_H
@@ -8,12 +8,19 @@
 
 
 OpenGLContext::OpenGLContext(QWidget *parent)
-    : QOpenGLWidget(parent)
+    : QOpenGLWidget(parent), m_boundProgram(0)
 {}
 
 OpenGLContext::~OpenGLContext()
 {}
 
+void OpenGLContext::useProgram(GLuint prog) {
+    if (prog != m_boundProgram) {
+        glUseProgram(prog);
+        m_boundProgram = prog;
+    }
+}
+
 inline const char *glGS(GLenum e)
 {
     return reinterpret_cast<const char *>(glGetString(e));
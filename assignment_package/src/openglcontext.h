@@ -17,4 +17,12 @@ public:
     void printGLErrorLog();
     void printLinkInfoLog(int prog);
     void printShaderInfoLog(int shader);
+
+    // glUseProgram, skipped if prog is already in use
+    void useProgram(GLuint prog);
+
+protected:
+    // Which program useProgram() last bound. A new context has none bound,
+    // so this goes back to 0 whenever the context is recreated.
+    GLuint m_boundProgram;
 };
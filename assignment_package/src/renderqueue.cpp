@@ -0,0 +1,105 @@
+#include "renderqueue.h"
+#include <algorithm>
+#include <cstring>
+
+RenderQueue::RenderQueue(OpenGLContext *context)
+    : mp_context(context), m_items(), m_programModels(), m_stats()
+{}
+
+uint64_t RenderQueue::makeKey(RenderPass pass, const ShaderProgram *program, const Texture *texture, float depth) {
+    // Non-negative floats sort the same way as their bit patterns
+    uint32_t depthBits;
+    depth = std::max(depth, 0.f);
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    // Only the low bits of each handle fit, so different programs or
+    // textures can share bits. That only costs an extra state change:
+    // flush() compares the pointers themselves before binding anything.
+    uint64_t programBits = program->prog & 0xff;
+    // 0 is kept for no texture, and the rest must stay below 0x100 so
+    // they never carry into the program's bits
+    uint64_t textureBits = texture == nullptr ? 0 : texture->m_textureHandle % 0xff + 1;
+    // Opaque:      pass 63-56 | program 55-48 | texture 47-40 | depth 31-0
+    // Transparent: pass 63-56 | ~depth 47-16 | program 15-8 | texture 7-0
+    uint64_t key = uint64_t(pass) << 56;
+    if (pass == PASS_TRANSPARENT) {
+        // Back to front matters more than state changes for blending
+        key |= uint64_t(~depthBits) << 16 | programBits << 8 | textureBits;
+    } else {
+        key |= programBits << 48 | textureBits << 40 | depthBits;
+    }
+    return key;
+}
+
+void RenderQueue::submit(RenderPass pass, ShaderProgram *program, Texture *texture,
+                         Drawable &drawable, const glm::mat4 &model, float depth) {
+    m_items.push_back(Item{makeKey(pass, program, texture, depth), pass, program, texture,
+                           &drawable, nullptr, nullptr, model});
+}
+
+void RenderQueue::submit(RenderPass pass, ShaderProgram *program, Texture *texture,
+                         GeometryArena &arena, const MultiDrawBatch &batch, float depth) {
+    m_items.push_back(Item{makeKey(pass, program, texture, depth), pass, program, texture,
+                           nullptr, &arena, &batch, glm::mat4()});
+}
+
+void RenderQueue::setModel(ShaderProgram *program, const glm::mat4 &model) {
+    auto found = m_programModels.find(program);
+    if (found != m_programModels.end() && found->second == model) {
+        return;
+    }
+    program->setModelMatrix(model);
+    m_programModels[program] = model;
+    ++m_stats.modelUploads;
+}
+
+void RenderQueue::flush() {
+    m_stats = RenderQueueStats{static_cast<int>(m_items.size()), 0, 0, 0};
+    // Stable, so items with equal keys draw in the order they were submitted
+    std::stable_sort(m_items.begin(), m_items.end(), [](const Item &a, const Item &b) {
+        return a.key < b.key;
+    });
+
+    const ShaderProgram *program = nullptr;
+    const Texture *texture = nullptr;
+    bool depthTest = true;
+    for(Item &item : m_items) {
+        // Overlays draw on top of everything
+        bool wantDepthTest = item.pass != PASS_OVERLAY;
+        if (wantDepthTest != depthTest) {
+            if (wantDepthTest) {
+                mp_context->glEnable(GL_DEPTH_TEST);
+            } else {
+                mp_context->glDisable(GL_DEPTH_TEST);
+            }
+            depthTest = wantDepthTest;
+        }
+        if (item.program != program) {
+            item.program->useMe();
+            program = item.program;
+            ++m_stats.programChanges;
+        }
+        if (item.texture != nullptr && item.texture != texture) {
+            item.texture->bind(0);
+            texture = item.texture;
+            ++m_stats.textureChanges;
+        }
+        setModel(item.program, item.model);
+        if (item.arena != nullptr) {
+            item.program->drawMultiInterleaved(*item.arena, *item.batch);
+        } else {
+            item.program->draw(*item.drawable);
+        }
+    }
+    if (!depthTest) {
+        mp_context->glEnable(GL_DEPTH_TEST);
+    }
+    m_items.clear();
+}
+
+void RenderQueue::invalidate() {
+    m_programModels.clear();
+}
+
+RenderQueueStats RenderQueue::stats() const {
+    return m_stats;
+}
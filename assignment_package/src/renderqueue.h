@@ -0,0 +1,75 @@
+#pragma once
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "openglcontext.h"
+#include "glm_includes.h"
+#include "shaderprogram.h"
+#include "texture.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Passes are drawn in this order. Opaque geometry goes before the sky so
+// the sky's fragment shader only runs where nothing covers it, and
+// transparent geometry goes after both so it blends over them.
+enum RenderPass : unsigned char {
+    PASS_OPAQUE, PASS_SKY, PASS_TRANSPARENT, PASS_OVERLAY
+};
+
+// Counters for the last flush()
+struct RenderQueueStats {
+    int items;
+    int programChanges;
+    int textureChanges;
+    int modelUploads;
+};
+
+// Draws are collected over the frame and issued together, sorted by a key
+// of (pass, program, texture, depth) so each program and texture is
+// usually bound once per pass rather than once per draw. The key is only
+// an ordering heuristic; which state to bind is never read from it. Opaque items are sorted front
+// to back and transparent ones back to front, before program and texture.
+// Model matrices are only uploaded when they differ from the one the
+// program already has.
+class RenderQueue {
+private:
+    struct Item {
+        uint64_t key;
+        RenderPass pass;
+        ShaderProgram *program;
+        Texture *texture;
+        // Exactly one of drawable and arena is set
+        Drawable *drawable;
+        GeometryArena *arena;
+        const MultiDrawBatch *batch;
+        glm::mat4 model;
+    };
+
+    OpenGLContext *mp_context;
+    std::vector<Item> m_items;
+    std::unordered_map<const ShaderProgram*, glm::mat4> m_programModels;
+    RenderQueueStats m_stats;
+
+    static uint64_t makeKey(RenderPass pass, const ShaderProgram *program, const Texture *texture, float depth);
+    void setModel(ShaderProgram *program, const glm::mat4 &model);
+
+public:
+    RenderQueue(OpenGLContext *context);
+
+    // depth is the item's distance from the camera
+    void submit(RenderPass pass, ShaderProgram *program, Texture *texture,
+                Drawable &drawable, const glm::mat4 &model, float depth = 0.f);
+    // Meshes in an arena, already in world space
+    void submit(RenderPass pass, ShaderProgram *program, Texture *texture,
+                GeometryArena &arena, const MultiDrawBatch &batch, float depth = 0.f);
+
+    // Draws everything submitted since the last flush, then empties the queue
+    void flush();
+    // Forget which model matrices the programs have, e.g. after relinking them
+    void invalidate();
+
+    RenderQueueStats stats() const;
+};
+
+#endif // RENDERQUEUE_H
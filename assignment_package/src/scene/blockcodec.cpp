@@ -0,0 +1,210 @@
+#include "blockcodec.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+static bool isBlockType(unsigned char t) {
+    return t <= WATER;
+}
+
+void BlockCodec::encode(const ChunkBlocks &blocks, const ChunkBlocks *generated, std::vector<unsigned char> &out) {
+    size_t start = out.size();
+    out.push_back(RUNS);
+    encodeRuns(blocks, out);
+    // Keep whichever of the two complete encodings is shorter
+    size_t palette = out.size();
+    encodePalette(blocks, out);
+    if (out.size() - palette < palette - start) {
+        out.erase(out.begin() + start, out.begin() + palette);
+    } else {
+        out.resize(palette);
+    }
+    if (generated == nullptr) {
+        return;
+    }
+
+    size_t differing = 0;
+    for(size_t i = 0; i < blocks.size(); ++i) {
+        differing += blocks[i] != (*generated)[i];
+    }
+    size_t runBytes = out.size() - start;
+    size_t sparseBytes = 1 + 3 * differing;
+    size_t bitmapBytes = 1 + blocks.size() / 8 + differing;
+    if (runBytes <= std::min(sparseBytes, bitmapBytes)) {
+        return;
+    }
+
+    out.resize(start);
+    if (sparseBytes <= bitmapBytes) {
+        out.push_back(SPARSE);
+        for(size_t i = 0; i < blocks.size(); ++i) {
+            if (blocks[i] != (*generated)[i]) {
+                out.push_back(static_cast<unsigned char>(i & 0xff));
+                out.push_back(static_cast<unsigned char>(i >> 8));
+                out.push_back(blocks[i]);
+            }
+        }
+    } else {
+        out.push_back(BITMAP);
+        size_t bitmap = out.size();
+        out.resize(bitmap + blocks.size() / 8, 0);
+        for(size_t i = 0; i < blocks.size(); ++i) {
+            if (blocks[i] != (*generated)[i]) {
+                out[bitmap + i / 8] |= 1 << (i % 8);
+                out.push_back(blocks[i]);
+            }
+        }
+    }
+}
+
+bool BlockCodec::isDelta(const unsigned char *data, size_t size) {
+    return size > 0 && (data[0] == SPARSE || data[0] == BITMAP);
+}
+
+bool BlockCodec::decode(const unsigned char *data, size_t size, ChunkBlocks &blocks) {
+    bool ok = size > 0;
+    if (ok && isBlockType(data[0])) {
+        // Untagged, from before deltas
+        ok = decodeRuns(data, size, blocks);
+    } else if (ok && data[0] == RUNS) {
+        ok = decodeRuns(data + 1, size - 1, blocks);
+    } else if (ok && data[0] == PALETTE) {
+        ok = decodePalette(data + 1, size - 1, blocks);
+    } else if (ok && data[0] == SPARSE) {
+        ok = (size - 1) % 3 == 0;
+        for(size_t p = 1; ok && p < size; p += 3) {
+            size_t i = data[p] | (data[p + 1] << 8);
+            ok = isBlockType(data[p + 2]);
+            if (ok) {
+                blocks[i] = static_cast<BlockType>(data[p + 2]);
+            }
+        }
+    } else if (ok && data[0] == BITMAP) {
+        const unsigned char *bitmap = data + 1;
+        size_t value = 1 + blocks.size() / 8;
+        ok = size >= value;
+        for(size_t i = 0; ok && i < blocks.size(); ++i) {
+            if (bitmap[i / 8] & (1 << (i % 8))) {
+                ok = value < size && isBlockType(data[value]);
+                if (ok) {
+                    blocks[i] = static_cast<BlockType>(data[value++]);
+                }
+            }
+        }
+        ok = ok && value == size;
+    } else {
+        ok = false;
+    }
+    if (!ok) {
+        blocks.fill(EMPTY);
+    }
+    return ok;
+}
+
+void BlockCodec::encodeRuns(const ChunkBlocks &blocks, std::vector<unsigned char> &out) {
+    size_t i = 0;
+    while (i < blocks.size()) {
+        BlockType t = blocks[i];
+        size_t end = i + 1;
+        while (end < blocks.size() && blocks[end] == t) {
+            ++end;
+        }
+        size_t run = end - i - 1;
+        out.push_back(static_cast<unsigned char>(t));
+        out.push_back(static_cast<unsigned char>(run & 0xff));
+        out.push_back(static_cast<unsigned char>(run >> 8));
+        i = end;
+    }
+}
+
+bool BlockCodec::decodeRuns(const unsigned char *data, size_t size, ChunkBlocks &blocks) {
+    if (size % 3 != 0) {
+        return false;
+    }
+    size_t i = 0;
+    for(size_t p = 0; p < size; p += 3) {
+        size_t run = (data[p + 1] | (data[p + 2] << 8)) + 1;
+        if (!isBlockType(data[p]) || i + run > blocks.size()) {
+            return false;
+        }
+        std::fill_n(blocks.begin() + i, run, static_cast<BlockType>(data[p]));
+        i += run;
+    }
+    return i == blocks.size();
+}
+
+void BlockCodec::encodePalette(const ChunkBlocks &blocks, std::vector<unsigned char> &out) {
+    // Index of each type in the palette, or -1 if it isn't in it yet
+    std::array<int, 256> index;
+    index.fill(-1);
+    std::vector<unsigned char> palette;
+    for(BlockType t : blocks) {
+        if (index[t] < 0) {
+            index[t] = static_cast<int>(palette.size());
+            palette.push_back(static_cast<unsigned char>(t));
+        }
+    }
+    int bits = 0;
+    while ((size_t(1) << bits) < palette.size()) {
+        ++bits;
+    }
+
+    out.push_back(PALETTE);
+    out.push_back(static_cast<unsigned char>(palette.size() - 1));
+    out.insert(out.end(), palette.begin(), palette.end());
+    size_t i = 0;
+    while (i < blocks.size()) {
+        BlockType t = blocks[i];
+        size_t end = i + 1;
+        while (end < blocks.size() && blocks[end] == t) {
+            ++end;
+        }
+        uint32_t v = (static_cast<uint32_t>(end - i - 1) << bits) | static_cast<uint32_t>(index[t]);
+        while (v >= 0x80) {
+            out.push_back(static_cast<unsigned char>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(v));
+        i = end;
+    }
+}
+
+bool BlockCodec::decodePalette(const unsigned char *data, size_t size, ChunkBlocks &blocks) {
+    if (size == 0 || size < 2 + size_t(data[0])) {
+        return false;
+    }
+    size_t count = size_t(data[0]) + 1;
+    const unsigned char *palette = data + 1;
+    for(size_t i = 0; i < count; ++i) {
+        if (!isBlockType(palette[i])) {
+            return false;
+        }
+    }
+    int bits = 0;
+    while ((size_t(1) << bits) < count) {
+        ++bits;
+    }
+    uint32_t mask = (uint32_t(1) << bits) - 1;
+
+    size_t i = 0;
+    size_t p = 1 + count;
+    while (p < size) {
+        uint32_t v = 0;
+        int shift = 0;
+        do {
+            if (p == size || shift > 28) {
+                return false;
+            }
+            v |= uint32_t(data[p] & 0x7f) << shift;
+            shift += 7;
+        } while (data[p++] & 0x80);
+        size_t run = (v >> bits) + 1;
+        size_t at = v & mask;
+        if (at >= count || i + run > blocks.size()) {
+            return false;
+        }
+        std::fill_n(blocks.begin() + i, run, static_cast<BlockType>(palette[at]));
+        i += run;
+    }
+    return i == blocks.size();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef BLOCKCODEC_H
+#define BLOCKCODEC_H
+
+#include "chunk.h"
+#include <cstddef>
+#include <vector>
+
+// Turns a Chunk's blocks into bytes for saving, and back. Terrain is
+// procedural, so a saved Chunk is usually stored as just the blocks that
+// differ from what generateChunk() makes for it, and loading one means
+// generating it and applying those. A payload starts with a tag byte
+// saying how the rest is laid out:
+//   RUNS:   every block, as (type, run length - 1) triples with the
+//           length a little-endian uint16
+//   SPARSE: the blocks that differ from generation, as
+//           (little-endian uint16 index, type) triples in index order
+//   BITMAP: a bit per block, set where it differs from generation,
+//           then the types of those blocks in index order
+//   PALETTE: every block, as a count and list of the distinct types,
+//           then each run as a varint of ((length - 1) << bits) | index
+//           into the list, with bits just enough for the list's size
+// Payloads from before the tag was added are bare RUNS; no tag is a
+// valid block type, so the two can't be confused.
+class BlockCodec {
+public:
+    enum Format : unsigned char {
+        RUNS = 0x80, SPARSE = 0x81, BITMAP = 0x82, PALETTE = 0x83
+    };
+
+    // Writes whichever format is smallest. generated, if given, holds the
+    // blocks generateChunk() makes for the same Chunk.
+    static void encode(const ChunkBlocks &blocks, const ChunkBlocks *generated, std::vector<unsigned char> &out);
+    // Does decoding this payload need the generated blocks first?
+    static bool isDelta(const unsigned char *data, size_t size);
+    // Replaces blocks with the ones in the payload. For a delta, blocks
+    // must already hold the generated blocks. Returns false, leaving
+    // every block EMPTY, if the payload is damaged.
+    static bool decode(const unsigned char *data, size_t size, ChunkBlocks &blocks);
+    // Writes blocks as PALETTE, which needs nothing but the payload to
+    // decode. Used to pack cold chunks in memory.
+    static void encodePalette(const ChunkBlocks &blocks, std::vector<unsigned char> &out);
+
+private:
+    static void encodeRuns(const ChunkBlocks &blocks, std::vector<unsigned char> &out);
+    static bool decodeRuns(const unsigned char *data, size_t size, ChunkBlocks &blocks);
+    static bool decodePalette(const unsigned char *data, size_t size, ChunkBlocks &blocks);
+};
+
+#endif // BLOCKCODEC_H
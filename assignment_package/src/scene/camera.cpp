@@ -18,7 +18,8 @@ Camera::Camera(const Camera &c)
       m_height(c.m_height),
       m_near_clip(c.m_near_clip),
       m_far_clip(c.m_far_clip),
-      m_aspect(c.m_aspect)
+      m_aspect(c.m_aspect),
+      theta(c.theta), phi(c.phi)
 {}
 
 
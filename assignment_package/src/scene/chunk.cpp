@@ -1,16 +1,34 @@
 #include "chunk.h"
+#include "blockcodec.h"
+#include "zonearena.h"
+#include <chrono>
 #include <iostream>
 
-Chunk::Chunk(OpenGLContext* context)
-    : Drawable(context), m_blocks(), m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}},
-      x_offset(0), z_offset(0), generating(false), generated(false)
+// Only ever changed on the main thread
+static ColdStats s_coldStats = {0, 0, 0, 0};
+
+Chunk::Chunk(OpenGLContext* context, const sPtr<ZoneArena> &arena, int slot)
+    : Drawable(context), mp_blocks(nullptr), m_arena(arena), m_coldArena(), m_slot(slot), m_ownBlocks(), m_packed(), m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}},
+      mp_opaqueArena(nullptr), mp_transArena(nullptr), m_opaqueMesh(), m_transMesh(), m_refs(0),
+      x_offset(0), z_offset(0), generating(false), generated(false), modified(false),
+      lastAccess(0), meshNeighbors(0),
+      meshMinY(0.f), meshMaxY(256.f), occluderHeights()
 {
-    std::fill_n(m_blocks.begin(), 65536, EMPTY);
+    if (m_arena != nullptr) {
+        mp_blocks = &m_arena->slot(slot);
+    } else {
+        // Value-initialized, so every block starts out EMPTY
+        m_ownBlocks = mkU<ChunkBlocks>();
+        mp_blocks = m_ownBlocks.get();
+    }
 }
 
 // Does bounds checking with at()
 BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
-    return m_blocks.at(x + 16 * y + 16 * 256 * z);
+    if (mp_blocks == nullptr) {
+        thaw();
+    }
+    return mp_blocks->at(x + 16 * y + 16 * 256 * z);
 }
 
 // Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
@@ -20,7 +38,10 @@ BlockType Chunk::getBlockAt(int x, int y, int z) const {
 
 // Does bounds checking with at()
 void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
-    m_blocks.at(x + 16 * y + 16 * 256 * z) = t;
+    if (mp_blocks == nullptr) {
+        thaw();
+    }
+    mp_blocks->at(x + 16 * y + 16 * 256 * z) = t;
 }
 
 
@@ -40,10 +61,131 @@ void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
     }
 }
 
+void Chunk::unlinkNeighbors() {
+    for(auto &n : m_neighbors) {
+        if(n.second != nullptr) {
+            n.second->m_neighbors[oppositeDirection.at(n.first)] = nullptr;
+            n.second = nullptr;
+        }
+    }
+}
+
+const ChunkBlocks& Chunk::blocks() const {
+    if (mp_blocks == nullptr) {
+        thaw();
+    }
+    return *mp_blocks;
+}
+
+ChunkBlocks& Chunk::blocks() {
+    if (mp_blocks == nullptr) {
+        thaw();
+    }
+    return *mp_blocks;
+}
+
+void Chunk::copyBlocks(ChunkBlocks &out) const {
+    if (mp_blocks != nullptr) {
+        out = *mp_blocks;
+    } else {
+        BlockCodec::decode(m_packed.data(), m_packed.size(), out);
+    }
+}
+
+void Chunk::freeze() {
+    if (mp_blocks == nullptr) {
+        return;
+    }
+    m_packed.clear();
+    BlockCodec::encodePalette(*mp_blocks, m_packed);
+    m_packed.shrink_to_fit();
+    // The arena goes once the last of its chunks lets go of it
+    mp_blocks = nullptr;
+    m_ownBlocks.reset();
+    m_coldArena = m_arena;
+    m_arena.reset();
+    ++s_coldStats.freezes;
+}
+
+void Chunk::thaw() const {
+    if (mp_blocks != nullptr) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    // Nothing else uses the slot, so it is still free if the arena is
+    m_arena = m_coldArena.lock();
+    m_coldArena.reset();
+    if (m_arena != nullptr) {
+        mp_blocks = &m_arena->slot(m_slot);
+    } else {
+        m_ownBlocks = mkU<ChunkBlocks>();
+        mp_blocks = m_ownBlocks.get();
+    }
+    BlockCodec::decode(m_packed.data(), m_packed.size(), *mp_blocks);
+    std::vector<unsigned char>().swap(m_packed);
+    uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            std::chrono::steady_clock::now() - start).count());
+    ++s_coldStats.thaws;
+    s_coldStats.thawNs += ns;
+    if (ns > s_coldStats.maxThawNs) {
+        s_coldStats.maxThawNs = ns;
+    }
+}
+
+bool Chunk::isCold() const {
+    return mp_blocks == nullptr;
+}
+
+size_t Chunk::blockBytes() const {
+    if (mp_blocks == nullptr) {
+        return m_packed.capacity();
+    }
+    return m_ownBlocks != nullptr ? sizeof(ChunkBlocks) : 0;
+}
+
+ColdStats Chunk::coldStats() {
+    return s_coldStats;
+}
+
+void Chunk::resetColdPeak() {
+    s_coldStats.maxThawNs = 0;
+}
+
+float ColdStats::averageThawUs() const {
+    return thaws == 0 ? 0.f : thawNs / 1000.f / thaws;
+}
+
+bool Chunk::isReferenced() const {
+    return m_refs.load(std::memory_order_acquire) > 0;
+}
+
+ChunkNeighbors Chunk::neighbors() const {
+    ChunkNeighbors out;
+    out.fill(nullptr);
+    for(const auto &n : m_neighbors) {
+        out[n.first] = n.second;
+    }
+    return out;
+}
+
+unsigned char Chunk::neighborMask() const {
+    unsigned char mask = 0;
+    for(const auto &n : m_neighbors) {
+        if(n.second != nullptr) {
+            mask |= 1 << n.first;
+        }
+    }
+    return mask;
+}
+
+bool Chunk::hasAllNeighbors() const {
+    return neighborMask() == ((1 << XPOS) | (1 << XNEG) | (1 << ZPOS) | (1 << ZNEG));
+}
+
 // Check each "face" of the block at <x,y,z> and return a 6 length
 // array that indicates which faces should be drawn.
 // Order of vector: +x, -x, +y, -y, +z, -z
-std::array<bool, 6> Chunk::checkBlockFaces(int x, int y, int z) {
+std::array<bool, 6> Chunk::checkBlockFaces(int x, int y, int z, const ChunkNeighbors &neighbors) const {
     // Init the output to all true
     std::array<bool, 6> output;
     for(int i = 0; i < 6; ++i) {
@@ -51,11 +193,19 @@ std::array<bool, 6> Chunk::checkBlockFaces(int x, int y, int z) {
     }
 
     // Perform bounds checking on all indices
-    // even though at() is used
-    if (x < 15 && getBlockAt(x + 1, y, z) != EMPTY) {
+    // even though at() is used.
+    // Blocks on the x or z border are checked against the neighboring
+    // Chunk instead, if it exists; otherwise the face is drawn.
+    const Chunk *xPos = neighbors[XPOS];
+    const Chunk *xNeg = neighbors[XNEG];
+    const Chunk *zPos = neighbors[ZPOS];
+    const Chunk *zNeg = neighbors[ZNEG];
+    if ((x < 15 && getBlockAt(x + 1, y, z) != EMPTY) ||
+            (x == 15 && xPos != nullptr && xPos->getBlockAt(0, y, z) != EMPTY)) {
         output[0] = false;
     }
-    if (x > 0 && getBlockAt(x - 1, y, z) != EMPTY) {
+    if ((x > 0 && getBlockAt(x - 1, y, z) != EMPTY) ||
+            (x == 0 && xNeg != nullptr && xNeg->getBlockAt(15, y, z) != EMPTY)) {
         output[1] = false;
     }
     if (y < 255 && getBlockAt(x, y + 1, z) != EMPTY) {
@@ -64,10 +214,12 @@ std::array<bool, 6> Chunk::checkBlockFaces(int x, int y, int z) {
     if (y > 0 && getBlockAt(x, y - 1, z) != EMPTY) {
         output[3] = false;
     }
-    if (z < 15 && getBlockAt(x, y, z + 1) != EMPTY) {
+    if ((z < 15 && getBlockAt(x, y, z + 1) != EMPTY) ||
+            (z == 15 && zPos != nullptr && zPos->getBlockAt(x, y, 0) != EMPTY)) {
         output[4] = false;
     }
-    if (z > 0 && getBlockAt(x, y, z - 1) != EMPTY) {
+    if ((z > 0 && getBlockAt(x, y, z - 1) != EMPTY) ||
+            (z == 0 && zNeg != nullptr && zNeg->getBlockAt(x, y, 15) != EMPTY)) {
         output[5] = false;
     }
 
@@ -113,8 +265,8 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
             break;
     }
 
-    // Create a translation matrix based on the x, y, z components
-    glm::mat4 translate = glm::translate(glm::mat4(), glm::vec3(x, y, z));
+    // The block's corner; each vertex is an offset from it
+    glm::vec4 origin(x, y, z, 0.f);
 
     // Copied coordinates from cube initialization.
     // Could be done in less lines
@@ -123,23 +275,23 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Right face
     if (faces[0]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         //face_vbo.push_back(uvTop);
 
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         //UL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -147,22 +299,22 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Left face
     if (faces[1]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         //face_vbo.push_back(uvTop);
         // LR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -170,22 +322,22 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Top face
     if (faces[2]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         //face_vbo.push_back(uvTop);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -193,22 +345,22 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Bottom face
     if (faces[3]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         //face_vbo.push_back(uvTop);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         //face_vbo.push_back(uvBot);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -216,22 +368,22 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Front face
     if (faces[4]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         //face_vbo.push_back(uvTop);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         //face_vbo.push_back(uvBot);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -239,22 +391,22 @@ std::vector<glm::vec4> Chunk::createFaces(std::array<bool, 6> faces, int x, int
     // Back face
     if (faces[5]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         //face_vbo.push_back(uvTop);
         // LR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         //face_vbo.push_back(uvBot);
         // LL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         //face_vbo.push_back(uvBot);
         // UL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         //face_vbo.push_back(uvTop);
@@ -396,8 +548,9 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
             break;
     }
 
-    // Create a translation matrix based on the x, y, z components
-    glm::mat4 translate = glm::translate(glm::mat4(), glm::vec3(x, y, z));
+    // The block's corner in world space; each vertex is an offset from it,
+    // so no matrix is needed per vertex and none is needed per chunk to draw
+    glm::vec4 origin(x + x_offset, y, z + z_offset, 0.f);
 
     // Copied coordinates from cube initialization.
     // Could be done in less lines
@@ -406,25 +559,25 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Right face
     if (faces[0]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         face_vbo.push_back(sideUR); //UV
 
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         face_vbo.push_back(sideLR);
 
         // LL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         face_vbo.push_back(sideLL);
 
         //UL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(1,0,0,0)); // Normal
         face_vbo.push_back(sideUL);
@@ -432,22 +585,22 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Left face
     if (faces[1]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         face_vbo.push_back(sideUR);
         // LR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         face_vbo.push_back(sideLR);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         face_vbo.push_back(sideLL);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(-1,0,0,0)); // Normal
         face_vbo.push_back(sideUL);
@@ -455,22 +608,22 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Top face
     if (faces[2]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         face_vbo.push_back(topUR);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         face_vbo.push_back(topLR);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         face_vbo.push_back(topLL);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,1,0,0)); // Normal
         face_vbo.push_back(topUL);
@@ -478,22 +631,22 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Bottom face
     if (faces[3]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         face_vbo.push_back(botUR);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         face_vbo.push_back(botLR);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         face_vbo.push_back(botLL);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,-1,0,0)); // Normal
         face_vbo.push_back(botUL);
@@ -501,22 +654,22 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Front face
     if (faces[4]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         face_vbo.push_back(sideUR);
         // LR
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         face_vbo.push_back(sideLR);
         // LL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         face_vbo.push_back(sideLL);
         // UL
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,1,0)); // Normal
         face_vbo.push_back(sideUL);
@@ -524,22 +677,22 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     // Back face
     if (faces[5]) {
         // UR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         face_vbo.push_back(sideUR);
         // LR
-        face_vbo.push_back(translate * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         face_vbo.push_back(sideLR);
         // LL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         face_vbo.push_back(sideLL);
         // UL
-        face_vbo.push_back(translate * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
+        face_vbo.push_back(origin + glm::vec4(1.0f, 1.0f, 0.0f, 1.0f)); // Position
         face_vbo.push_back(color); // Color
         face_vbo.push_back(glm::vec4(0,0,-1,0)); // Normal
         face_vbo.push_back(sideUL);
@@ -548,128 +701,230 @@ std::vector<glm::vec4> Chunk::createFacesWithUV(std::array<bool, 6> faces, int x
     return face_vbo;
 }
 
-// Buffering function as specified in the project specs.
-// Might need to be moved elsewhere when it's needed for future milestones.
-void Chunk::bufferData(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx) {
-    m_count = idx.size();
-
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+AABB Chunk::bounds() const {
+    return AABB{glm::vec3(x_offset, meshMinY, z_offset), glm::vec3(x_offset + 16, meshMaxY, z_offset + 16)};
+}
 
-    // Utilizes just the position buffer for the only VBO;
-    // should probably create a separate one if it ends up matterings
-    generatePos();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(glm::vec4), interleaved.data(), GL_STATIC_DRAW);
+void Chunk::extendVerticalExtent(const std::vector<glm::vec4> &interleaved, float &minY, float &maxY) {
+    // Positions are the first of every vertex's four vec4s
+    for(size_t i = 0; i < interleaved.size(); i += GeometryArena::VEC4S_PER_VERTEX) {
+        minY = std::min(minY, interleaved[i].y);
+        maxY = std::max(maxY, interleaved[i].y);
+    }
 }
 
-void Chunk::bufferDataTrans(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx){
-    m_count_trans = idx.size();
+void Chunk::computeOccluderHeights(std::array<int, 16> &heights) const {
+    const ChunkBlocks &blocks = this->blocks();
+    heights.fill(256);
+    for(int x = 0; x < 16; ++x) {
+        for(int z = 0; z < 16; ++z) {
+            int y = 0;
+            while (y < 256) {
+                BlockType t = blocks.at(x + 16 * y + 16 * 256 * z);
+                if (t == EMPTY || t == WATER || t == LAVA) {
+                    break;
+                }
+                ++y;
+            }
+            int &cell = heights[(x / 4) + 4 * (z / 4)];
+            cell = std::min(cell, y);
+        }
+    }
+}
 
-    generateIdxTrans();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdxTrans);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count_trans * sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+void Chunk::appendOccluders(std::vector<AABB> &out) const {
+    for(int i = 0; i < 16; ++i) {
+        if (occluderHeights[i] == 0) {
+            continue;
+        }
+        glm::vec3 min(x_offset + 4 * (i % 4), 0, z_offset + 4 * (i / 4));
+        out.push_back(AABB{min, min + glm::vec3(4, occluderHeights[i], 4)});
+    }
+}
 
-    generateTrans();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufTrans);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(glm::vec4), interleaved.data(), GL_STATIC_DRAW);
+MeshSections::MeshSections()
+    : opaqueStarts(), transStarts(), connectivity()
+{
+    opaqueStarts.fill(0);
+    transStarts.fill(0);
+    connectivity.fill(~uint64_t(0));
 }
 
-void Chunk::create() {
-    // Interleaved takes the form pos0col0nor0pos1col1nor1...
-    std::vector<glm::vec4> interleaved;
-    std::vector<glm::vec4> interleavedTrans;
+static bool isSeeThrough(BlockType t) {
+    return t == EMPTY || t == WATER || t == LAVA;
+}
 
-    // Loop through each block in the chunk array;
-    // check each neighbor of the block, and add a face
-    // for each neighbor that is EMPTY
-    for(int x = 0; x < 16; ++x) {
-        for(int y = 0; y < 256; ++y) {
-            for(int z = 0; z < 16; ++z) {
-                // Skip all empty blocks; they won't have faces to draw
-                if (getBlockAt(x, y, z) == EMPTY) {
-                    continue;
+void Chunk::computeSectionConnectivity(std::array<uint64_t, SECTION_COUNT> &out) const {
+    const ChunkBlocks &blocks = this->blocks();
+    std::array<bool, 4096> seen;
+    std::vector<int> stack;
+    for(int s = 0; s < SECTION_COUNT; ++s) {
+        seen.fill(false);
+        uint64_t connected = 0;
+        for(int start = 0; start < 4096; ++start) {
+            // Cells are numbered x + 16 * y + 256 * z within the section
+            if (seen[start] || !isSeeThrough(blocks[(start & 15) + 16 * (16 * s + ((start >> 4) & 15)) + 16 * 256 * (start >> 8)])) {
+                continue;
+            }
+            // Flood fill this pocket of see-through blocks,
+            // noting which faces of the section it touches
+            unsigned char faces = 0;
+            seen[start] = true;
+            stack.push_back(start);
+            while (!stack.empty()) {
+                int cell = stack.back();
+                stack.pop_back();
+                int x = cell & 15, y = (cell >> 4) & 15, z = cell >> 8;
+                if (x == 15) faces |= 1 << XPOS;
+                if (x == 0)  faces |= 1 << XNEG;
+                if (y == 15) faces |= 1 << YPOS;
+                if (y == 0)  faces |= 1 << YNEG;
+                if (z == 15) faces |= 1 << ZPOS;
+                if (z == 0)  faces |= 1 << ZNEG;
+                const std::array<glm::ivec3, 6> steps {{
+                    {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+                }};
+                for(const glm::ivec3 &d : steps) {
+                    int nx = x + d.x, ny = y + d.y, nz = z + d.z;
+                    if (nx < 0 || nx > 15 || ny < 0 || ny > 15 || nz < 0 || nz > 15) {
+                        continue;
+                    }
+                    int next = nx + 16 * ny + 256 * nz;
+                    if (!seen[next] && isSeeThrough(blocks[nx + 16 * (16 * s + ny) + 16 * 256 * nz])) {
+                        seen[next] = true;
+                        stack.push_back(next);
+                    }
                 }
-                // Check which faces need to be drawn
-                std::array<bool, 6> faces = checkBlockFaces(x, y, z);
-                // Generate a vector of all the interleaved face data
-                //std::vector<glm::vec4> new_faces = createFaces(faces, x, y, z);
-                std::vector<glm::vec4> new_faces = createFacesWithUV(faces, x, y, z);
-                // Append this vector to the current interleaved
-                if(getBlockAt(x, y, z) == WATER || getBlockAt(x, y, z) == LAVA){
-                    interleavedTrans.insert(std::end(interleavedTrans), std::begin(new_faces), std::end(new_faces));
-                } else {
-                    interleaved.insert(std::end(interleaved), std::begin(new_faces), std::end(new_faces));
+            }
+            for(int a = 0; a < 6; ++a) {
+                for(int b = 0; b < 6; ++b) {
+                    if ((faces & (1 << a)) && (faces & (1 << b))) {
+                        connected |= uint64_t(1) << (a * 6 + b);
+                    }
                 }
-
             }
         }
+        out[s] = connected;
     }
-    // Create the index buffer from the interleaved VBO
-    std::vector<GLuint> idx;
-    std::vector<GLuint> idxTrans;
+}
 
-    for(uint i = 0; i < interleavedTrans.size(); i +=4) {
-        idxTrans.push_back(i);
-        idxTrans.push_back(i+1);
-        idxTrans.push_back(i+2);
-        idxTrans.push_back(i);
-        idxTrans.push_back(i+2);
-        idxTrans.push_back(i+3);
-    }
+Chunk* Chunk::getNeighbor(Direction dir) const {
+    auto it = m_neighbors.find(dir);
+    return it == m_neighbors.end() ? nullptr : it->second;
+}
 
-    for(uint i = 0; i < interleaved.size(); i +=4) {
-        idx.push_back(i);
-        idx.push_back(i+1);
-        idx.push_back(i+2);
-        idx.push_back(i);
-        idx.push_back(i+2);
-        idx.push_back(i+3);
+void Chunk::setArenas(GeometryArena *opaque, GeometryArena *trans) {
+    mp_opaqueArena = opaque;
+    mp_transArena = trans;
+}
+
+const ArenaAllocation& Chunk::opaqueMesh() const {
+    return m_opaqueMesh;
+}
+
+const ArenaAllocation& Chunk::transMesh() const {
+    return m_transMesh;
+}
+
+void Chunk::releaseMesh() {
+    if (mp_opaqueArena != nullptr) {
+        mp_opaqueArena->free(m_opaqueMesh);
+    }
+    if (mp_transArena != nullptr) {
+        mp_transArena->free(m_transMesh);
     }
+}
+
+// Buffering function as specified in the project specs.
+// Might need to be moved elsewhere when it's needed for future milestones.
+void Chunk::bufferData(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx,
+                       StagingRing *staging) {
+    m_count = idx.size();
+    // Chunks are re-meshed when a late neighbor arrives; the arena
+    // frees the old mesh's space before taking new space
+    mp_opaqueArena->upload(m_opaqueMesh, interleaved, idx, staging);
+}
+
+void Chunk::bufferDataTrans(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx,
+                            StagingRing *staging) {
+    m_count_trans = idx.size();
+    mp_transArena->upload(m_transMesh, interleaved, idx, staging);
+}
+
+void Chunk::create() {
+    // Interleaved takes the form pos0col0nor0pos1col1nor1...
+    std::vector<glm::vec4> interleaved;
+    std::vector<GLuint> idx;
+    std::vector<glm::vec4> interleavedTrans;
+    std::vector<GLuint> idxTrans;
+    create(interleaved, idx, interleavedTrans, idxTrans, neighbors(), nullptr, &sections);
 
     // Upload this data to the VBO
     bufferDataTrans(interleavedTrans, idxTrans);
     bufferData(interleaved, idx);
+    meshMinY = 256.f;
+    meshMaxY = 0.f;
+    extendVerticalExtent(interleaved, meshMinY, meshMaxY);
+    extendVerticalExtent(interleavedTrans, meshMinY, meshMaxY);
+    computeOccluderHeights(occluderHeights);
 
     // Don't generate this chunk again
     generated = true;
+    meshNeighbors = neighborMask();
 }
 
-// Poor design, but this is just the duplicated create() that passes the results to vectors
-// instead of pushing it to VBOs so the threads can use the function.
+// Builds the VBO data into vectors rather than buffering it, so the
+// threads can use it; create() buffers what this builds.
 void Chunk::create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx,
-                   std::vector<glm::vec4> &interleavedTrans, std::vector<GLuint> &idxTrans) {
+                   std::vector<glm::vec4> &interleavedTrans, std::vector<GLuint> &idxTrans,
+                   const ChunkNeighbors &neighbors, const JobHandle *job, MeshSections *sections) {
     // Interleaved takes the form pos0col0nor0pos1col1nor1...
 
-    // Loop through each block in the chunk array;
+    // Loop through each block in the chunk array, one section at a time;
     // check each neighbor of the block, and add a face
     // for each neighbor that is EMPTY
-    for(int x = 0; x < 16; ++x) {
-        for(int y = 0; y < 256; ++y) {
-            for(int z = 0; z < 16; ++z) {
-                // Skip all empty blocks; they won't have faces to draw
-                if (getBlockAt(x, y, z) == EMPTY) {
-                    continue;
-                }
-                // Check which faces need to be drawn
-                std::array<bool, 6> faces = checkBlockFaces(x, y, z);
-                // Generate a vector of all the interleaved face data
-                //std::vector<glm::vec4> new_faces = createFaces(faces, x, y, z);
-                std::vector<glm::vec4> new_faces = createFacesWithUV(faces, x, y, z);
-                // Append this vector to the current interleaved
-                if(getBlockAt(x, y, z) == WATER || getBlockAt(x, y, z) == LAVA){
-                    interleavedTrans.insert(std::end(interleavedTrans), std::begin(new_faces), std::end(new_faces));
-                } else {
-                    interleaved.insert(std::end(interleaved), std::begin(new_faces), std::end(new_faces));
-                }
+    for(int s = 0; s < SECTION_COUNT; ++s) {
+        // Bail out between sections if nobody wants this mesh any more
+        if (job != nullptr && job->isCancelled()) {
+            return;
+        }
+        if (sections != nullptr) {
+            // 16 vec4s per quad, 6 indices per quad
+            sections->opaqueStarts[s] = interleaved.size() / 16 * 6;
+            sections->transStarts[s] = interleavedTrans.size() / 16 * 6;
+        }
+        for(int x = 0; x < 16; ++x) {
+            for(int y = 16 * s; y < 16 * (s + 1); ++y) {
+                for(int z = 0; z < 16; ++z) {
+                    // Skip all empty blocks; they won't have faces to draw
+                    if (getBlockAt(x, y, z) == EMPTY) {
+                        continue;
+                    }
+                    // Check which faces need to be drawn
+                    std::array<bool, 6> faces = checkBlockFaces(x, y, z, neighbors);
+                    // Generate a vector of all the interleaved face data
+                    //std::vector<glm::vec4> new_faces = createFaces(faces, x, y, z);
+                    std::vector<glm::vec4> new_faces = createFacesWithUV(faces, x, y, z);
+                    // Append this vector to the current interleaved
+                    if(getBlockAt(x, y, z) == WATER || getBlockAt(x, y, z) == LAVA){
+                        interleavedTrans.insert(std::end(interleavedTrans), std::begin(new_faces), std::end(new_faces));
+                    } else {
+                        interleaved.insert(std::end(interleaved), std::begin(new_faces), std::end(new_faces));
+                    }
 
+                }
             }
         }
     }
-    // Create the index buffer from the interleaved VBO
+    if (sections != nullptr) {
+        sections->opaqueStarts[SECTION_COUNT] = interleaved.size() / 16 * 6;
+        sections->transStarts[SECTION_COUNT] = interleavedTrans.size() / 16 * 6;
+        computeSectionConnectivity(sections->connectivity);
+    }
+    // Create the index buffer from the interleaved VBO.
+    // Every vertex is 4 vec4s, and every 4 vertices make one quad.
 
-    for(uint i = 0; i < interleavedTrans.size(); i +=4) {
+    for(uint i = 0; i < interleavedTrans.size() / 4; i +=4) {
         idxTrans.push_back(i);
         idxTrans.push_back(i+1);
         idxTrans.push_back(i+2);
@@ -678,7 +933,7 @@ void Chunk::create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx
         idxTrans.push_back(i+3);
     }
 
-    for(uint i = 0; i < interleaved.size(); i +=4) {
+    for(uint i = 0; i < interleaved.size() / 4; i +=4) {
         idx.push_back(i);
         idx.push_back(i+1);
         idx.push_back(i+2);
@@ -686,9 +941,9 @@ void Chunk::create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx
         idx.push_back(i+2);
         idx.push_back(i+3);
     }
-
-    // Don't generate this chunk again
-    generated = true;
+    // Note that generated is not set here; the main thread sets it once
+    // the data has actually been buffered, since this job may still be
+    // cancelled before then.
     /*
     // Interleaved takes the form pos0col0nor0pos1col1nor1...
 
@@ -712,7 +967,7 @@ void Chunk::create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx
         }
     }
     // Create the index buffer from the interleaved VBO
-    for(uint i = 0; i < interleaved.size(); i +=4) {
+    for(uint i = 0; i < interleaved.size() / 4; i +=4) {
         idx.push_back(i);
         idx.push_back(i+1);
         idx.push_back(i+2);
@@ -2,9 +2,16 @@
 #include "smartpointerhelp.h"
 #include "glm_includes.h"
 #include "drawable.h"
+#include "jobhandle.h"
+#include "geometryarena.h"
+#include "frustum.h"
 #include <array>
+#include <atomic>
 #include <unordered_map>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <utility>
 
 
 //using namespace std;
@@ -18,6 +25,19 @@ enum BlockType : unsigned char
     EMPTY, GRASS, DIRT, STONE, SNOW, ICE, LAVA, WATER
 };
 
+// Every block of a Chunk, indexed x + 16 * y + 16 * 256 * z
+typedef std::array<BlockType, 65536> ChunkBlocks;
+
+// Counts of chunks made cold and brought back, for all chunks together
+struct ColdStats {
+    uint64_t freezes;
+    uint64_t thaws;
+    uint64_t thawNs;
+    uint64_t maxThawNs;    // Since the last resetColdPeak()
+
+    float averageThawUs() const;
+};
+
 // The six cardinal directions in 3D space
 enum Direction : unsigned char
 {
@@ -33,6 +53,30 @@ struct EnumHash {
     }
 };
 
+class Chunk;
+class ZoneArena;
+// The neighbors a mesh is built against, indexed by Direction;
+// the YPOS and YNEG entries are always nullptr
+typedef std::array<const Chunk*, 6> ChunkNeighbors;
+
+// A Chunk's mesh is built one 16 x 16 x 16 section at a time, from the
+// bottom up, so each section's faces form one contiguous range of the
+// index buffers and can be drawn or skipped on their own
+const int SECTION_COUNT = 16;
+
+struct MeshSections {
+    // Where each section's indices start, in indices; element
+    // SECTION_COUNT is the end of the last section
+    std::array<GLsizei, SECTION_COUNT + 1> opaqueStarts;
+    std::array<GLsizei, SECTION_COUNT + 1> transStarts;
+    // Bit (from * 6 + to) is set when a face of the section (as a Direction)
+    // can be seen from another through its empty and fluid blocks
+    std::array<uint64_t, SECTION_COUNT> connectivity;
+
+    // No geometry, with every section fully connected
+    MeshSections();
+};
+
 // One Chunk is a 16 x 256 x 16 section of the world,
 // containing all the Minecraft blocks in that area.
 // We divide the world into Chunks in order to make
@@ -42,33 +86,132 @@ struct EnumHash {
 
 class Chunk : public Drawable {
 private:
-    // All of the blocks contained within this Chunk
-    std::array<BlockType, 65536> m_blocks;
+    // All of the blocks contained within this Chunk: a slot of its
+    // zone's arena, or else m_ownBlocks. Null while the Chunk is cold,
+    // when they are only held packed in m_packed.
+    mutable ChunkBlocks *mp_blocks;
+    mutable sPtr<ZoneArena> m_arena;
+    // While cold, the arena is only watched, so it can be freed once the
+    // rest of the zone has let go of it too; until then thawing goes
+    // back into the same slot
+    mutable std::weak_ptr<ZoneArena> m_coldArena;
+    int m_slot;
+    mutable uPtr<ChunkBlocks> m_ownBlocks;
+    mutable std::vector<unsigned char> m_packed;
     // This Chunk's four neighbors to the north, south, east, and west
     // The third input to this map just lets us use a Direction as
     // a key for this map.
     // These allow us to properly determine
     std::unordered_map<Direction, Chunk*, EnumHash> m_neighbors;
 
+    // The shared buffers this Chunk's meshes are stored in, and where in
+    // them. Set by Terrain once the Chunk is part of the world.
+    GeometryArena *mp_opaqueArena;
+    GeometryArena *mp_transArena;
+    ArenaAllocation m_opaqueMesh;
+    ArenaAllocation m_transMesh;
+
+    // How many ChunkRefs hold this Chunk
+    mutable std::atomic<int> m_refs;
+    friend class ChunkRef;
+
 public:
-    Chunk(OpenGLContext* context);
+    // Keeps its blocks in the given slot of arena if there is one,
+    // or else in an array of its own. Either way they start out EMPTY.
+    Chunk(OpenGLContext* context, const sPtr<ZoneArena> &arena = nullptr, int slot = 0);
+    Chunk(const Chunk&) = delete;
+    Chunk& operator=(const Chunk&) = delete;
 
     // Needed for multithreading
     int x_offset, z_offset;
     bool generating;
     bool generated;
+    // Is a job holding a ChunkRef to this Chunk? If so it may be reading
+    // the blocks, and an evicted Chunk isn't freed until it lets go.
+    bool isReferenced() const;
+    // Set once the player has changed a block, so the Chunk is no
+    // longer what generateChunk() would produce
+    bool modified;
+    // When Terrain last read or wrote one of its blocks, in ms on
+    // Terrain's own clock. Main thread only.
+    int64_t lastAccess;
+    // Which neighbors (as a neighborMask()) were linked when
+    // the VBO data currently on the GPU was built
+    unsigned char meshNeighbors;
+    // Lowest and highest y covered by the mesh currently on the GPU,
+    // so culling can use a box much shorter than the whole column
+    float meshMinY, meshMaxY;
+    AABB bounds() const;
+    // Widens [minY, maxY] to cover every vertex position in interleaved
+    static void extendVerticalExtent(const std::vector<glm::vec4> &interleaved, float &minY, float &maxY);
+    // For each 4 x 4 group of columns, how far up from y = 0 every one of
+    // them is solid (not empty or fluid). Each group is a box that is
+    // known to block sight, used by occlusion culling.
+    std::array<int, 16> occluderHeights;
+    void computeOccluderHeights(std::array<int, 16> &heights) const;
+    // The layout and connectivity of the mesh currently on the GPU
+    MeshSections sections;
+    // Flood fills each section's see-through blocks to find which
+    // of its faces are connected
+    void computeSectionConnectivity(std::array<uint64_t, SECTION_COUNT> &out) const;
+    // The neighbor in a horizontal direction, or nullptr if there isn't one yet
+    Chunk* getNeighbor(Direction dir) const;
+    // Appends the occluder boxes described by occluderHeights
+    void appendOccluders(std::vector<AABB> &out) const;
 
     BlockType getBlockAt(unsigned int x, unsigned int y, unsigned int z) const;
     BlockType getBlockAt(int x, int y, int z) const;
     void setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t);
     void linkNeighbor(uPtr<Chunk>& neighbor, Direction dir);
-    std::array<bool, 6> checkBlockFaces(int x, int y, int z);
+    // Clears the pointers between this Chunk and its neighbors, both ways
+    void unlinkNeighbors();
+    // The neighbors linked right now. Jobs mesh against a copy taken
+    // when they start, since the links change on the main thread.
+    ChunkNeighbors neighbors() const;
+    // All of the blocks at once, for saving and loading
+    const ChunkBlocks& blocks() const;
+    ChunkBlocks& blocks();
+    // Copies the blocks into out without thawing the Chunk
+    void copyBlocks(ChunkBlocks &out) const;
+
+    // A cold Chunk keeps its blocks as a palette and runs (usually a few
+    // KiB rather than 64) until something reads or writes a block, which
+    // thaws it again. Freezing and thawing are main thread only, and a
+    // Chunk a job may be reading (see isReferenced()) must not be frozen;
+    // a job never thaws a Chunk, since it only reads referenced ones.
+    void freeze();
+    void thaw() const;
+    bool isCold() const;
+    // Memory held for the blocks outside of any ZoneArena, packed or not
+    size_t blockBytes() const;
+    static ColdStats coldStats();
+    static void resetColdPeak();
+    // One bit (1 << Direction) for each of the four horizontal neighbors
+    // that has been linked to this Chunk
+    unsigned char neighborMask() const;
+    // Are all four horizontal neighbors linked? Faces on the Chunk's
+    // border can only be culled correctly once they are.
+    bool hasAllNeighbors() const;
+    std::array<bool, 6> checkBlockFaces(int x, int y, int z, const ChunkNeighbors &neighbors) const;
     std::vector<glm::vec4> createFaces(std::array<bool, 6> faces, int x, int y, int z);
     std::vector<glm::vec4> createFacesWithUV(std::array<bool, 6> faces, int x, int y, int z);
-    void bufferData(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx);
-    void bufferDataTrans(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx);
+    void setArenas(GeometryArena *opaque, GeometryArena *trans);
+    const ArenaAllocation& opaqueMesh() const;
+    const ArenaAllocation& transMesh() const;
+    // Gives this Chunk's space in the arenas back
+    void releaseMesh();
+    // Vertex positions are in world space, since chunks drawn
+    // together in one call can't each have their own model matrix
+    void bufferData(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx,
+                    StagingRing *staging = nullptr);
+    void bufferDataTrans(const std::vector<glm::vec4> &interleaved, const std::vector<GLuint> &idx,
+                         StagingRing *staging = nullptr);
     void create() override;
-    void create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx, std::vector<glm::vec4> &interleavedTrans, std::vector<GLuint> &idxTrans);
+    // Worker-thread version of create(). If a job is given, it is polled
+    // between sections and meshing stops early once it has been cancelled.
+    // If sections is given, it is filled in to describe the new mesh.
+    void create(std::vector<glm::vec4> &interleaved, std::vector<GLuint> &idx, std::vector<glm::vec4> &interleavedTrans, std::vector<GLuint> &idxTrans,
+                const ChunkNeighbors &neighbors, const JobHandle *job = nullptr, MeshSections *sections = nullptr);
 
     // Fills chunk with procedural height field data
     void generateChunk(int x_offset, int z_offset);
@@ -84,3 +227,46 @@ public:
     int mountainHeight(int x, int z);
     void createBlock(int x, int z, int x_offset, int z_offset);
 };
+
+// Keeps a Chunk from being freed while it is held, even after Terrain
+// has evicted it. A new reference may only be taken on the main thread,
+// from a Chunk that is still in the world; references can then be
+// copied and dropped on any thread.
+class ChunkRef {
+private:
+    Chunk *mp_chunk;
+
+public:
+    ChunkRef() : mp_chunk(nullptr) {}
+    explicit ChunkRef(Chunk *c) : mp_chunk(c) {
+        if (mp_chunk != nullptr) {
+            mp_chunk->m_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    ChunkRef(const ChunkRef &other) : ChunkRef(other.mp_chunk) {}
+    ChunkRef(ChunkRef &&other) : mp_chunk(other.mp_chunk) {
+        other.mp_chunk = nullptr;
+    }
+    ChunkRef& operator=(ChunkRef other) {
+        std::swap(mp_chunk, other.mp_chunk);
+        return *this;
+    }
+    ~ChunkRef() {
+        reset();
+    }
+
+    // Lets go of the Chunk. Whatever this thread did with it happens
+    // before Terrain sees it unreferenced.
+    void reset() {
+        if (mp_chunk != nullptr) {
+            mp_chunk->m_refs.fetch_sub(1, std::memory_order_release);
+            mp_chunk = nullptr;
+        }
+    }
+    Chunk* get() const {
+        return mp_chunk;
+    }
+    Chunk* operator->() const {
+        return mp_chunk;
+    }
+};
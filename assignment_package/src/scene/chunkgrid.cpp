@@ -0,0 +1,45 @@
+#include "chunkgrid.h"
+#include <climits>
+
+ChunkGrid::ChunkGrid()
+    : m_slots(SIZE * SIZE, Slot{INT_MIN, INT_MIN, nullptr}),
+      m_min(-SIZE / 2, -SIZE / 2)
+{}
+
+void ChunkGrid::set(int cx, int cz, Chunk *c) {
+    if (!contains(cx, cz)) {
+        return;
+    }
+    Slot &s = m_slots[(cx & MASK) | ((cz & MASK) << SHIFT)];
+    s.cx = cx;
+    s.cz = cz;
+    s.chunk = c;
+}
+
+std::vector<glm::ivec2> ChunkGrid::recenter(int cx, int cz) {
+    glm::ivec2 oldMin = m_min;
+    m_min = glm::ivec2(cx - SIZE / 2, cz - SIZE / 2);
+    std::vector<glm::ivec2> entered;
+    if (m_min == oldMin) {
+        return entered;
+    }
+    for(int z = m_min.y; z < m_min.y + SIZE; ++z) {
+        for(int x = m_min.x; x < m_min.x + SIZE; ++x) {
+            bool wasInside = x >= oldMin.x && x < oldMin.x + SIZE
+                    && z >= oldMin.y && z < oldMin.y + SIZE;
+            if (!wasInside) {
+                // Whatever the slot held has just left the window
+                Slot &s = m_slots[(x & MASK) | ((z & MASK) << SHIFT)];
+                s.cx = x;
+                s.cz = z;
+                s.chunk = nullptr;
+                entered.push_back(glm::ivec2(x, z));
+            }
+        }
+    }
+    return entered;
+}
+
+glm::ivec2 ChunkGrid::minCorner() const {
+    return m_min;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef CHUNKGRID_H
+#define CHUNKGRID_H
+
+#include "glm_includes.h"
+#include <vector>
+
+class Chunk;
+
+// A fixed-size window of Chunk pointers centred on the player, addressed
+// toroidally by (cx & MASK, cz & MASK) where cx and cz are chunk
+// coordinates (world coordinates >> 4). Moving the window only rewrites
+// the slots that wrapped around, and each slot remembers which chunk it
+// holds, so a lookup is a mask, a shift, an index and a compare.
+// Terrain keeps every slot in the window in step with its chunk map, so
+// a miss inside the window means the chunk isn't loaded.
+class ChunkGrid {
+public:
+    static const int SHIFT = 5;
+    static const int SIZE = 1 << SHIFT; // Chunks along each side
+    static const int MASK = SIZE - 1;
+
+private:
+    struct Slot {
+        int cx, cz;
+        Chunk *chunk;
+    };
+    std::vector<Slot> m_slots;
+    // The chunk coordinates of the window's lowest corner
+    glm::ivec2 m_min;
+
+public:
+    ChunkGrid();
+
+    // Is this chunk inside the window?
+    bool contains(int cx, int cz) const {
+        return static_cast<unsigned int>(cx - m_min.x) < static_cast<unsigned int>(SIZE)
+                && static_cast<unsigned int>(cz - m_min.y) < static_cast<unsigned int>(SIZE);
+    }
+    // The chunk at these chunk coordinates, or nullptr if the slot holds
+    // something else. Only meaningful for chunks inside the window.
+    Chunk* find(int cx, int cz) const {
+        const Slot &s = m_slots[(cx & MASK) | ((cz & MASK) << SHIFT)];
+        return (s.cx == cx && s.cz == cz) ? s.chunk : nullptr;
+    }
+    // c may be nullptr to clear the slot. Ignored outside the window.
+    void set(int cx, int cz, Chunk *c);
+
+    // Moves the window to be centred on the given chunk. Returns the
+    // chunks that have newly come into it, which the caller must fill.
+    std::vector<glm::ivec2> recenter(int cx, int cz);
+    glm::ivec2 minCorner() const;
+};
+
+#endif // CHUNKGRID_H
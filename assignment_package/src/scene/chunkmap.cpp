@@ -0,0 +1,135 @@
+#include "chunkmap.h"
+#include <climits>
+
+// Chunk coordinates are world coordinates >> 4, so never this far out
+static const int64_t EMPTY_KEY = INT64_MIN;
+
+ChunkMap::Table::Table(size_t capacity)
+    : mask(capacity - 1), cells(mkU<Slot[]>(capacity))
+{
+    for(size_t i = 0; i < capacity; ++i) {
+        cells[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        cells[i].chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ChunkMap::ChunkMap(EpochManager &epochs)
+    : m_epochs(epochs), m_table(new Table(MIN_CAPACITY)), m_chunks(0), m_used(0), m_rebuilds(0)
+{}
+
+ChunkMap::~ChunkMap() {
+    delete m_table.load(std::memory_order_relaxed);
+}
+
+int64_t ChunkMap::toKey(int cx, int cz) {
+    return static_cast<int64_t>((uint64_t(uint32_t(cx)) << 32) | uint32_t(cz));
+}
+
+// The finalizer of splitmix64, so neighboring chunks spread out
+size_t ChunkMap::hash(int64_t key) {
+    uint64_t h = static_cast<uint64_t>(key);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<size_t>(h ^ (h >> 31));
+}
+
+Chunk* ChunkMap::find(int cx, int cz) const {
+    EpochGuard guard(m_epochs);
+    int64_t key = toKey(cx, cz);
+    const Table *t = m_table.load(std::memory_order_acquire);
+    // Tables are never more than half full, so this always ends
+    for(size_t i = hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        int64_t k = t->cells[i].key.load(std::memory_order_acquire);
+        if (k == key) {
+            return t->cells[i].chunk.load(std::memory_order_acquire);
+        }
+        if (k == EMPTY_KEY) {
+            return nullptr;
+        }
+    }
+}
+
+void ChunkMap::insert(int cx, int cz, Chunk *c) {
+    if (c == nullptr) {
+        erase(cx, cz);
+        return;
+    }
+    int64_t key = toKey(cx, cz);
+    Table *t = m_table.load(std::memory_order_relaxed);
+    size_t i = hash(key) & t->mask;
+    for(;; i = (i + 1) & t->mask) {
+        int64_t k = t->cells[i].key.load(std::memory_order_relaxed);
+        if (k == key) {
+            if (t->cells[i].chunk.load(std::memory_order_relaxed) == nullptr) {
+                ++m_chunks;
+            }
+            t->cells[i].chunk.store(c, std::memory_order_release);
+            return;
+        }
+        if (k == EMPTY_KEY) {
+            break;
+        }
+    }
+    if (2 * (m_used + 1) > t->mask + 1) {
+        rebuild(m_chunks + 1);
+        insert(cx, cz, c);
+        return;
+    }
+    // The key goes first, so a reader that sees it also sees the slot is taken
+    t->cells[i].key.store(key, std::memory_order_release);
+    t->cells[i].chunk.store(c, std::memory_order_release);
+    ++m_used;
+    ++m_chunks;
+}
+
+void ChunkMap::erase(int cx, int cz) {
+    int64_t key = toKey(cx, cz);
+    Table *t = m_table.load(std::memory_order_relaxed);
+    for(size_t i = hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        int64_t k = t->cells[i].key.load(std::memory_order_relaxed);
+        if (k == key) {
+            if (t->cells[i].chunk.load(std::memory_order_relaxed) != nullptr) {
+                t->cells[i].chunk.store(nullptr, std::memory_order_release);
+                --m_chunks;
+            }
+            return;
+        }
+        if (k == EMPTY_KEY) {
+            return;
+        }
+    }
+}
+
+void ChunkMap::rebuild(size_t minCapacity) {
+    // Room to grow by as much again before the next rebuild
+    size_t capacity = MIN_CAPACITY;
+    while (capacity < 4 * minCapacity) {
+        capacity *= 2;
+    }
+    Table *old = m_table.load(std::memory_order_relaxed);
+    Table *table = new Table(capacity);
+    for(size_t i = 0; i <= old->mask; ++i) {
+        Chunk *c = old->cells[i].chunk.load(std::memory_order_relaxed);
+        if (c == nullptr) {
+            continue;
+        }
+        int64_t key = old->cells[i].key.load(std::memory_order_relaxed);
+        size_t j = hash(key) & table->mask;
+        while (table->cells[j].key.load(std::memory_order_relaxed) != EMPTY_KEY) {
+            j = (j + 1) & table->mask;
+        }
+        table->cells[j].key.store(key, std::memory_order_relaxed);
+        table->cells[j].chunk.store(c, std::memory_order_relaxed);
+    }
+    // Publishing with release makes every slot written above visible
+    // to a reader that loads the new table
+    m_table.store(table, std::memory_order_release);
+    m_epochs.retire([old]() { delete old; });
+    m_used = m_chunks;
+    ++m_rebuilds;
+}
+
+ChunkMapStats ChunkMap::stats() const {
+    const Table *t = m_table.load(std::memory_order_relaxed);
+    return ChunkMapStats{m_chunks, t->mask + 1, m_used - m_chunks, m_rebuilds};
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef CHUNKMAP_H
+#define CHUNKMAP_H
+
+#include "smartpointerhelp.h"
+#include "epochmanager.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class Chunk;
+
+// Counters describing a ChunkMap's table
+struct ChunkMapStats {
+    size_t chunks;
+    size_t capacity;
+    size_t tombstones;      // Slots of erased chunks, dropped by the next rebuild
+    uint64_t rebuilds;
+};
+
+// An index from chunk coordinates (world coordinates >> 4) to Chunk
+// pointers that any thread can read without taking a lock, while the
+// main thread alone inserts and erases. It is an open-addressed table
+// of atomic slots, probed linearly:
+//  - A slot's key is published before its chunk, and never changes once
+//    set, so a reader that finds its key knows the chunk it loads next
+//    belongs to it. A null chunk reads as not there.
+//  - Erasing only clears the chunk, leaving the key as a tombstone so
+//    that no probe passing over it is cut short. The same chunk coming
+//    back reuses its old slot.
+//  - Once keys and tombstones fill half the table, the live entries are
+//    copied into a new table that is then published in one atomic store
+//    (read-copy-update). Readers already in the old table finish there,
+//    and the old table is retired to the EpochManager for freeing once
+//    they have all left.
+// The map doesn't own its chunks. A pointer found in it may only be
+// used inside an EpochGuard on the same manager, entered before the
+// lookup; see Terrain::evictZone().
+class ChunkMap {
+public:
+    static const size_t MIN_CAPACITY = 1024;
+
+private:
+    struct Slot {
+        std::atomic<int64_t> key;
+        std::atomic<Chunk*> chunk;
+    };
+    struct Table {
+        size_t mask;
+        uPtr<Slot[]> cells;
+
+        explicit Table(size_t capacity);
+    };
+    EpochManager &m_epochs;
+    std::atomic<Table*> m_table;
+    // Only touched by the writer
+    size_t m_chunks;
+    size_t m_used;          // Slots with a key, live or tombstone
+    uint64_t m_rebuilds;
+
+    static int64_t toKey(int cx, int cz);
+    static size_t hash(int64_t key);
+    // Copies the live entries into a table with room for at least
+    // minCapacity of them, and publishes it
+    void rebuild(size_t minCapacity);
+
+public:
+    explicit ChunkMap(EpochManager &epochs);
+    ~ChunkMap();
+    ChunkMap(const ChunkMap&) = delete;
+    ChunkMap& operator=(const ChunkMap&) = delete;
+
+    // Safe from any thread. nullptr if the chunk isn't in the map.
+    // Guards itself, but the caller needs a guard to use the result.
+    Chunk* find(int cx, int cz) const;
+    // Main thread only. Replaces whatever was stored for these coordinates.
+    void insert(int cx, int cz, Chunk *c);
+    void erase(int cx, int cz);
+
+    // Main thread only
+    ChunkMapStats stats() const;
+};
+
+#endif // CHUNKMAP_H
@@ -0,0 +1,132 @@
+#include "editjournal.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+static void putU32(unsigned char *out, uint32_t v) {
+    out[0] = static_cast<unsigned char>(v);
+    out[1] = static_cast<unsigned char>(v >> 8);
+    out[2] = static_cast<unsigned char>(v >> 16);
+    out[3] = static_cast<unsigned char>(v >> 24);
+}
+
+static uint32_t getU32(const unsigned char *in) {
+    return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+}
+
+// FNV-1a
+static uint32_t checksum(const unsigned char *data, size_t size) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < size; ++i) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+EditJournal::EditJournal()
+    : m_file(), m_groups(0)
+{}
+
+EditJournal::~EditJournal() {
+    close();
+}
+
+bool EditJournal::open(const QString &path, std::vector<BlockEdit> &replay) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QFile::ReadWrite)) {
+        return false;
+    }
+    qint64 size = m_file.size();
+    std::vector<unsigned char> data(static_cast<size_t>(size));
+    if (size > 0 && m_file.read(reinterpret_cast<char*>(data.data()), size) != size) {
+        m_file.close();
+        return false;
+    }
+
+    // Keep every whole group, stopping at the first damaged one
+    qint64 good = 0;
+    while (good + 4 <= size) {
+        uint32_t count = getU32(&data[good]);
+        qint64 bytes = 4 + qint64(count) * RECORD_BYTES + 4;
+        if (count == 0 || good + bytes > size) {
+            break;
+        }
+        const unsigned char *records = &data[good + 4];
+        if (checksum(records, count * RECORD_BYTES) != getU32(records + count * RECORD_BYTES)) {
+            break;
+        }
+        for(uint32_t i = 0; i < count; ++i) {
+            const unsigned char *r = records + i * RECORD_BYTES;
+            replay.push_back(BlockEdit{static_cast<int32_t>(getU32(r)), r[8],
+                                       static_cast<int32_t>(getU32(r + 4)),
+                                       static_cast<BlockType>(r[9]), static_cast<BlockType>(r[10])});
+        }
+        good += bytes;
+        ++m_groups;
+    }
+    // New groups must follow the last good one, not the damage
+    if (good < size) {
+        m_file.resize(good);
+    }
+    return m_file.seek(good);
+}
+
+void EditJournal::close() {
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool EditJournal::isOpen() const {
+    return m_file.isOpen();
+}
+
+bool EditJournal::append(const std::vector<BlockEdit> &edits) {
+    if (edits.empty() || !m_file.isOpen()) {
+        return false;
+    }
+    std::vector<unsigned char> group(4 + edits.size() * RECORD_BYTES + 4);
+    putU32(&group[0], static_cast<uint32_t>(edits.size()));
+    unsigned char *records = &group[4];
+    for(size_t i = 0; i < edits.size(); ++i) {
+        const BlockEdit &e = edits[i];
+        unsigned char *r = records + i * RECORD_BYTES;
+        putU32(r, static_cast<uint32_t>(e.x));
+        putU32(r + 4, static_cast<uint32_t>(e.z));
+        r[8] = static_cast<unsigned char>(e.y);
+        r[9] = e.before;
+        r[10] = e.after;
+    }
+    putU32(records + edits.size() * RECORD_BYTES, checksum(records, edits.size() * RECORD_BYTES));
+    qint64 bytes = static_cast<qint64>(group.size());
+    qint64 start = m_file.pos();
+    if (m_file.write(reinterpret_cast<const char*>(group.data()), bytes) != bytes || !sync()) {
+        // A torn group left in place would end replay there, taking
+        // every later group with it, so take it back out
+        m_file.resize(start);
+        m_file.seek(start);
+        return false;
+    }
+    ++m_groups;
+    return true;
+}
+
+bool EditJournal::reset() {
+    return m_file.isOpen() && m_file.resize(0) && m_file.seek(0) && sync();
+}
+
+bool EditJournal::sync() {
+    if (!m_file.flush()) {
+        return false;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    return ::fsync(m_file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+uint64_t EditJournal::groupCount() const {
+    return m_groups;
+}
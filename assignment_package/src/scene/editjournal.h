@@ -0,0 +1,56 @@
+#pragma once
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include "chunk.h"
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// One block changed by the player, in world coordinates
+struct BlockEdit {
+    int x, y, z;
+    BlockType before;
+    BlockType after;
+};
+
+// An append-only log of the player's block edits, so they survive a
+// crash without whole chunks being rewritten for every edit. Edits are
+// written in groups, each a count, 11 bytes per edit (x and z as int32,
+// then y, before and after as bytes) and a checksum, and the file is
+// synced once per group. A group that was cut short by a crash fails
+// its checksum and is dropped, along with anything after it.
+// All integers are little-endian.
+class EditJournal {
+public:
+    static const int RECORD_BYTES = 11;
+
+private:
+    QFile m_file;
+    uint64_t m_groups;
+
+    // Flushes to the OS, and on to the disk where the platform allows.
+    // False if either step failed.
+    bool sync();
+
+public:
+    EditJournal();
+    ~EditJournal();
+
+    // Opens the journal at path, creating it if need be, and appends
+    // every edit in it to replay, oldest first
+    bool open(const QString &path, std::vector<BlockEdit> &replay);
+    void close();
+    bool isOpen() const;
+
+    // Writes edits as one group. Returns true only once it is synced;
+    // a group that fails is removed again, so later ones still replay.
+    bool append(const std::vector<BlockEdit> &edits);
+    // Empties the journal, once everything in it has been saved elsewhere
+    bool reset();
+
+    uint64_t groupCount() const;
+};
+
+#endif // EDITJOURNAL_H
@@ -107,8 +107,9 @@ void Player::processInputs(InputBundle &inputs) {
         triggerDestroy = false;
         destroyBlock = true;
     }
+}
 
-    //Mouse
+void Player::updateLook(const InputBundle &inputs) {
     m_camera.setThetaPhi(inputs.mouseX, inputs.mouseY);
 }
 
@@ -35,7 +35,11 @@ public:
 
     void setCameraWidthHeight(unsigned int w, unsigned int h);
 
+    // Movement and physics only, in fixed steps
     void tick(float dT, InputBundle &input) override;
+    // Points the camera where the mouse says. Once a frame rather than
+    // once a tick, so every frame drawn looks the latest way.
+    void updateLook(const InputBundle &inputs);
     void flipFlightMode();
 
 //    static bool gridMarch(glm::vec3 rayOrigin, int axis, float length,
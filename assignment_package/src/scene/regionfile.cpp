@@ -0,0 +1,381 @@
+#include "regionfile.h"
+#include "chunk.h"
+#include "blockcodec.h"
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static void putU32(unsigned char *out, uint32_t v) {
+    out[0] = static_cast<unsigned char>(v);
+    out[1] = static_cast<unsigned char>(v >> 8);
+    out[2] = static_cast<unsigned char>(v >> 16);
+    out[3] = static_cast<unsigned char>(v >> 24);
+}
+
+static uint32_t getU32(const unsigned char *in) {
+    return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+}
+
+RegionFile::RegionFile(const QString &path)
+    : m_path(path), m_file(), m_table(), m_map(nullptr), m_size(0), m_liveBytes(0), m_compactions(0)
+{}
+
+RegionFile::~RegionFile() {
+    close();
+}
+
+int RegionFile::index(int lx, int lz) {
+    return (lx & MASK) | ((lz & MASK) << SHIFT);
+}
+
+bool RegionFile::open() {
+    m_file.setFileName(m_path);
+    if (!m_file.open(QFile::ReadWrite)) {
+        return false;
+    }
+    m_size = m_file.size();
+    m_liveBytes = 0;
+    if (m_size == 0) {
+        // A new region
+        m_table.fill(Entry{0, 0});
+        if (!writeHeader()) {
+            return false;
+        }
+        m_size = HEADER_BYTES;
+        return true;
+    }
+
+    std::vector<unsigned char> header(HEADER_BYTES);
+    if (m_size < HEADER_BYTES || !m_file.seek(0)
+            || m_file.read(reinterpret_cast<char*>(header.data()), HEADER_BYTES) != HEADER_BYTES
+            || getU32(&header[0]) != MAGIC || getU32(&header[4]) != VERSION) {
+        m_file.close();
+        return false;
+    }
+    for(int i = 0; i < CHUNK_COUNT; ++i) {
+        Entry e{getU32(&header[8 + 8 * i]), getU32(&header[12 + 8 * i])};
+        // A write cut short may have left an entry pointing past the end
+        if (e.offset < HEADER_BYTES || qint64(e.offset) + e.length > m_size) {
+            e = Entry{0, 0};
+        }
+        m_table[i] = e;
+        m_liveBytes += e.length;
+    }
+    return true;
+}
+
+void RegionFile::close() {
+    unmap();
+    if (m_file.isOpen()) {
+        m_file.flush();
+        m_file.close();
+    }
+}
+
+void RegionFile::unmap() {
+    if (m_map != nullptr) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+}
+
+bool RegionFile::writeHeader() {
+    std::vector<unsigned char> header(HEADER_BYTES);
+    putU32(&header[0], MAGIC);
+    putU32(&header[4], VERSION);
+    for(int i = 0; i < CHUNK_COUNT; ++i) {
+        putU32(&header[8 + 8 * i], m_table[i].offset);
+        putU32(&header[12 + 8 * i], m_table[i].length);
+    }
+    return m_file.seek(0)
+            && m_file.write(reinterpret_cast<const char*>(header.data()), HEADER_BYTES) == HEADER_BYTES;
+}
+
+const unsigned char* RegionFile::find(int lx, int lz, size_t &length) {
+    const Entry &e = m_table[index(lx, lz)];
+    if (e.offset == 0) {
+        return nullptr;
+    }
+    if (m_map == nullptr) {
+        m_map = m_file.map(0, m_size);
+        if (m_map == nullptr) {
+            return nullptr;
+        }
+    }
+    length = e.length;
+    return m_map + e.offset;
+}
+
+bool RegionFile::write(const std::vector<const RegionWrite*> &writes) {
+    unmap();
+    // The payloads are synced before the table points at them, so a write
+    // that is cut short leaves the old copies in place
+    std::vector<unsigned char> data;
+    for(const RegionWrite *w : writes) {
+        data.insert(data.end(), w->payload.begin(), w->payload.end());
+    }
+    qint64 bytes = static_cast<qint64>(data.size());
+    if (!m_file.seek(m_size)
+            || m_file.write(reinterpret_cast<const char*>(data.data()), bytes) != bytes
+            || !sync()) {
+        return false;
+    }
+    qint64 offset = m_size;
+    for(const RegionWrite *w : writes) {
+        int i = index(w->cx, w->cz);
+        qint64 length = static_cast<qint64>(w->payload.size());
+        m_liveBytes += length - m_table[i].length;
+        m_table[i] = Entry{static_cast<uint32_t>(offset), static_cast<uint32_t>(length)};
+        offset += length;
+    }
+    m_size = offset;
+    // Only once this returns are the payloads safe to drop from elsewhere
+    if (!writeHeader() || !sync()) {
+        return false;
+    }
+
+    qint64 stale = m_size - HEADER_BYTES - m_liveBytes;
+    if (stale > MIN_COMPACT_BYTES && stale > m_liveBytes) {
+        compact();
+    }
+    return true;
+}
+
+bool RegionFile::sync() {
+    if (!m_file.flush()) {
+        return false;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    return ::fsync(m_file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+void RegionFile::prefetch() {
+    if (m_map == nullptr) {
+        m_map = m_file.map(0, m_size);
+        if (m_map == nullptr) {
+            return;
+        }
+    }
+    volatile unsigned char sink = 0;
+    for(qint64 i = 0; i < m_size; i += 4096) {
+        sink = sink + m_map[i];
+    }
+}
+
+bool RegionFile::compact() {
+    unmap();
+    // Lay the live payloads out back to back after a new table
+    std::array<Entry, CHUNK_COUNT> table;
+    std::vector<unsigned char> data(HEADER_BYTES + m_liveBytes);
+    qint64 end = HEADER_BYTES;
+    for(int i = 0; i < CHUNK_COUNT; ++i) {
+        const Entry &e = m_table[i];
+        table[i] = Entry{0, 0};
+        if (e.offset == 0) {
+            continue;
+        }
+        if (!m_file.seek(e.offset)
+                || m_file.read(reinterpret_cast<char*>(&data[end]), e.length) != e.length) {
+            return false;
+        }
+        table[i] = Entry{static_cast<uint32_t>(end), e.length};
+        end += e.length;
+    }
+    putU32(&data[0], MAGIC);
+    putU32(&data[4], VERSION);
+    for(int i = 0; i < CHUNK_COUNT; ++i) {
+        putU32(&data[8 + 8 * i], table[i].offset);
+        putU32(&data[12 + 8 * i], table[i].length);
+    }
+
+    // Written and synced in full beside the old file, then renamed over
+    // it in one step, so a crash part way through leaves one or the other
+    // whole. The old file stays open until the new one is in place.
+    QString tmpPath = m_path + ".tmp";
+    QFile tmp(tmpPath);
+    bool written = tmp.open(QFile::WriteOnly | QFile::Truncate)
+            && tmp.write(reinterpret_cast<const char*>(data.data()), end) == end
+            && tmp.flush();
+#if defined(__unix__) || defined(__APPLE__)
+    written = written && ::fsync(tmp.handle()) == 0;
+#endif
+    tmp.close();
+    if (!written || std::rename(QFile::encodeName(tmpPath).constData(),
+                                QFile::encodeName(m_path).constData()) != 0) {
+        QFile::remove(tmpPath);
+        return false;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    // The rename itself is only durable once the directory is synced
+    int dir = ::open(QFile::encodeName(QFileInfo(m_path).absolutePath()).constData(), O_RDONLY);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+#endif
+    m_table = table;
+    m_size = end;
+    ++m_compactions;
+    m_file.close();
+    m_file.setFileName(m_path);
+    return m_file.open(QFile::ReadWrite);
+}
+
+qint64 RegionFile::fileSize() const {
+    return m_size;
+}
+
+qint64 RegionFile::liveBytes() const {
+    return m_liveBytes;
+}
+
+uint64_t RegionFile::compactions() const {
+    return m_compactions;
+}
+
+RegionStore::RegionStore()
+    : m_dir(), m_open(false), m_mutex(), m_regions(), m_stats()
+{}
+
+bool RegionStore::open(const QString &dir) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_regions.clear();
+    m_dir = dir;
+    m_open = QDir().mkpath(dir);
+    return m_open;
+}
+
+bool RegionStore::isOpen() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_open;
+}
+
+void RegionStore::close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_regions.clear();
+    m_open = false;
+}
+
+RegionFile* RegionStore::region(int cx, int cz, bool create) {
+    int rx = cx >> RegionFile::SHIFT;
+    int rz = cz >> RegionFile::SHIFT;
+    int64_t key = static_cast<int64_t>((uint64_t(uint32_t(rx)) << 32) | uint32_t(rz));
+    auto found = m_regions.find(key);
+    if (found != m_regions.end() && (found->second != nullptr || !create)) {
+        return found->second.get();
+    }
+    QString path = QDir(m_dir).filePath("r." + QString::number(rx) + "." + QString::number(rz) + ".mmr");
+    uPtr<RegionFile> file;
+    if (create || QFile::exists(path)) {
+        file = mkU<RegionFile>(path);
+        if (!file->open()) {
+            file = nullptr;
+        }
+    }
+    RegionFile *r = file.get();
+    m_regions[key] = std::move(file);
+    return r;
+}
+
+bool RegionStore::load(Chunk *c) {
+    auto start = std::chrono::steady_clock::now();
+    int cx = c->x_offset >> 4;
+    int cz = c->z_offset >> 4;
+    std::vector<unsigned char> payload;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_open) {
+            return false;
+        }
+        RegionFile *r = region(cx, cz, false);
+        size_t length = 0;
+        const unsigned char *data = r == nullptr ? nullptr : r->find(cx, cz, length);
+        if (data == nullptr) {
+            ++m_stats.misses;
+            return false;
+        }
+        payload.assign(data, data + length);
+    }
+    // Decoding may mean generating the chunk first, which
+    // shouldn't hold up anyone else's reads
+    if (BlockCodec::isDelta(payload.data(), payload.size())) {
+        c->generateChunk(c->x_offset, c->z_offset);
+    }
+    bool ok = BlockCodec::decode(payload.data(), payload.size(), c->blocks());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!ok) {
+        ++m_stats.misses;
+        return false;
+    }
+    ++m_stats.loads;
+    m_stats.loadNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+int RegionStore::save(std::vector<RegionWrite> &writes) {
+    std::sort(writes.begin(), writes.end(), [](const RegionWrite &a, const RegionWrite &b) {
+        int ra = a.cx >> RegionFile::SHIFT, rb = b.cx >> RegionFile::SHIFT;
+        return ra != rb ? ra < rb : (a.cz >> RegionFile::SHIFT) < (b.cz >> RegionFile::SHIFT);
+    });
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_open) {
+        return 0;
+    }
+    int written = 0;
+    std::vector<const RegionWrite*> group;
+    for(size_t i = 0; i < writes.size();) {
+        int rx = writes[i].cx >> RegionFile::SHIFT;
+        int rz = writes[i].cz >> RegionFile::SHIFT;
+        group.clear();
+        for(; i < writes.size() && writes[i].cx >> RegionFile::SHIFT == rx
+                && writes[i].cz >> RegionFile::SHIFT == rz; ++i) {
+            group.push_back(&writes[i]);
+        }
+        RegionFile *r = region(group[0]->cx, group[0]->cz, true);
+        if (r == nullptr || !r->write(group)) {
+            continue;
+        }
+        written += static_cast<int>(group.size());
+        for(const RegionWrite *w : group) {
+            m_stats.bytesWritten += w->payload.size();
+        }
+    }
+    m_stats.saves += written;
+    return written;
+}
+
+void RegionStore::prefetch(int cx, int cz) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_open) {
+        return;
+    }
+    RegionFile *r = region(cx, cz, false);
+    if (r != nullptr) {
+        r->prefetch();
+    }
+}
+
+RegionStats RegionStore::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RegionStats s = m_stats;
+    s.compactions = 0;
+    s.openRegions = 0;
+    for(const auto &r : m_regions) {
+        if (r.second != nullptr) {
+            s.compactions += r.second->compactions();
+            ++s.openRegions;
+        }
+    }
+    return s;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#ifndef REGIONFILE_H
+#define REGIONFILE_H
+
+#include "smartpointerhelp.h"
+#include <QFile>
+#include <QString>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class Chunk;
+
+// A Chunk's blocks encoded by BlockCodec, waiting to be written.
+// cx and cz are chunk coordinates (world coordinates >> 4).
+struct RegionWrite {
+    int cx, cz;
+    std::vector<unsigned char> payload;
+};
+
+// One file holding up to 32 x 32 Chunks of saved blocks. It starts with
+// a table giving each Chunk's payload offset and length (an offset of 0
+// means the Chunk isn't stored), followed by the payloads themselves.
+// Reads go through a memory mapping of the whole file, so loading a
+// Chunk costs a page-in and a decode (see BlockCodec). A rewritten Chunk's payload is
+// appended rather than overwritten, and once more than half the file is
+// stale payloads it is compacted into a fresh copy.
+// All integers are little-endian.
+class RegionFile {
+public:
+    static const int SHIFT = 5;
+    static const int SIZE = 1 << SHIFT; // Chunks along each side
+    static const int MASK = SIZE - 1;
+    static const int CHUNK_COUNT = SIZE * SIZE;
+    static const uint32_t MAGIC = 0x47524d4d; // "MMRG"
+    static const uint32_t VERSION = 1;
+    static const qint64 HEADER_BYTES = 8 + CHUNK_COUNT * 8;
+    // Stale bytes are tolerated up to this, whatever the live size
+    static const qint64 MIN_COMPACT_BYTES = 256 * 1024;
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t length;
+    };
+    QString m_path;
+    QFile m_file;
+    std::array<Entry, CHUNK_COUNT> m_table;
+    // Dropped before every write, since a mapped file can't always grow,
+    // and remade by the next read
+    uchar *m_map;
+    qint64 m_size;
+    qint64 m_liveBytes;
+    uint64_t m_compactions;
+
+    static int index(int lx, int lz);
+    bool writeHeader();
+    // Flushes and waits for everything written so far to reach the disk
+    bool sync();
+    void unmap();
+    // Rewrites the file with only the live payloads. If that fails the
+    // old file is left as it was, and still open.
+    bool compact();
+
+public:
+    RegionFile(const QString &path);
+    ~RegionFile();
+
+    // Opens the file, creating an empty one if it doesn't exist yet.
+    // Returns false if it can't be opened or isn't a region file.
+    bool open();
+    void close();
+
+    // The stored payload of the Chunk at (lx, lz) within the region, or
+    // nullptr if there isn't one. Only valid until the next write().
+    const unsigned char* find(int lx, int lz, size_t &length);
+    // Appends every payload in one write, then rewrites the table once.
+    // Each write's chunk coordinates are taken within the region.
+    // Returns true only once all of it is on disk.
+    bool write(const std::vector<const RegionWrite*> &writes);
+    // Maps the file and touches every page of it, so the loads
+    // that follow don't wait on the disk
+    void prefetch();
+
+    qint64 fileSize() const;
+    qint64 liveBytes() const;
+    uint64_t compactions() const;
+};
+
+// Counters for everything RegionStore has read and written
+struct RegionStats {
+    uint64_t loads;        // Chunks read from disk
+    uint64_t misses;       // Chunks asked for that weren't saved
+    uint64_t saves;
+    uint64_t loadNs;       // Total time spent reading, regenerating and decoding loaded chunks
+    uint64_t bytesWritten;
+    uint64_t compactions;
+    int openRegions;
+
+    float averageLoadUs() const {
+        return loads == 0 ? 0.f : loadNs / (loads * 1000.f);
+    }
+};
+
+// A saved world: a directory of RegionFiles, opened as they are first
+// needed. Safe to use from any thread; one lock covers every region.
+class RegionStore {
+private:
+    QString m_dir;
+    bool m_open;
+    mutable std::mutex m_mutex;
+    // nullptr for regions known to have no file yet
+    std::unordered_map<int64_t, uPtr<RegionFile>> m_regions;
+    RegionStats m_stats;
+
+    // The region holding the Chunk at chunk coordinates (cx, cz). Only
+    // creates its file if create is set. The lock must be held.
+    RegionFile* region(int cx, int cz, bool create);
+
+public:
+    RegionStore();
+
+    // Saves go to this directory, which is created if need be
+    bool open(const QString &dir);
+    bool isOpen() const;
+    // Flushes and closes every region
+    void close();
+
+    // Replaces the blocks of a newly made Chunk with its saved ones.
+    // Returns false if it hasn't been saved, or its payload is damaged,
+    // in which case it should be generated instead.
+    bool load(Chunk *c);
+    // Writes every payload, grouped so each region is written once.
+    // Reorders writes. Returns the number written and synced.
+    int save(std::vector<RegionWrite> &writes);
+    // Reads the region holding the Chunk at (cx, cz) into memory ahead
+    // of the loads for it, if it exists
+    void prefetch(int cx, int cz);
+
+    RegionStats stats() const;
+};
+
+#endif // REGIONFILE_H
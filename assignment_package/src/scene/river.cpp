@@ -76,14 +76,14 @@ void River::makeHalfCylinder(glm::ivec2 start, glm::ivec2 end, int r1, int r2) {
                 if (y <= 130) {
                     float sdf = sdRoundCone(p, glm::vec3(start.x, y, start.y), glm::vec3(end.x, y, end.y), r1, r2);
                     if(sdf <= 0) {
-                        terrain->setBlockAt(x, y, z, WATER);
+                        terrain->setGeneratedBlockAt(x, y, z, WATER);
                     }
                 } else if (y > 130) {
                     //empty, pretend y =120
                     glm::vec3 p2(x, 130, z);
                     float sdf = sdRoundCone(p2, glm::vec3(start.x, 130, start.y), glm::vec3(end.x, 130, end.y), r1, r2);
                     if(sdf <= 0) {
-                        terrain->setBlockAt(x, y, z, EMPTY);
+                        terrain->setGeneratedBlockAt(x, y, z, EMPTY);
                     }
                 }
             }
@@ -110,20 +110,20 @@ void River::expandWidth(int x, int z, int depth, int radius) {
                 if (xPosTerr <= xi && xi < terX && zPosTerr <= zj && zj < terZ) {
                     if ((i*i + j*j + k*k) <= (radius * radius)) {
                         if (k <= -1 * depth && terrain->hasChunkAt(xi, zj)) {
-                            terrain->setBlockAt(xi, radius + k + 200, zj, WATER);
+                            terrain->setGeneratedBlockAt(xi, radius + k + 200, zj, WATER);
                         } else if (terrain->hasChunkAt(xi, zj)) {
-                            terrain->setBlockAt(xi, radius + k + 200, zj, WATER);
+                            terrain->setGeneratedBlockAt(xi, radius + k + 200, zj, WATER);
                         }
                     } else if (terrain->hasChunkAt(xi, zj)){
                         for (int d = radius + 200; d < 255; d++) {
                             if (d <= radius * 2 + 200 && terrain->hasChunkAt(xi, zj)) {
-                                terrain->setBlockAt(xi, d, zj, WATER);
+                                terrain->setGeneratedBlockAt(xi, d, zj, WATER);
                             } else {
                                 if (terrain->getBlockAt(xi, d, zj) == WATER) {
                                     break;
                                 }
                                 if (terrain->hasChunkAt(xi, zj)) {
-                                    terrain->setBlockAt(xi, d, zj, WATER);
+                                    terrain->setGeneratedBlockAt(xi, d, zj, WATER);
                                 }
                             }
                         }
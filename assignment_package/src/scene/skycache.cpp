@@ -0,0 +1,94 @@
+#include "skycache.h"
+
+SkyCache::SkyCache(OpenGLContext *context, int faceSize)
+    : mp_context(context), mp_bake(nullptr), unifFace(-1), unifFaceSize(-1),
+      m_cubemap(0), m_fbo(0), m_faceSize(faceSize), m_bakedTime(-1.f), m_refreshCount(0)
+{}
+
+void SkyCache::create(ShaderProgram *bake) {
+    mp_bake = bake;
+    unifFace = mp_context->glGetUniformLocation(bake->prog, "u_Face");
+    unifFaceSize = mp_context->glGetUniformLocation(bake->prog, "u_FaceSize");
+
+    mp_context->glGenTextures(1, &m_cubemap);
+    mp_context->glActiveTexture(GL_TEXTURE0 + SKY_TEXTURE_SLOT);
+    mp_context->glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemap);
+    for(int face = 0; face < 6; ++face) {
+        mp_context->glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8,
+                                 m_faceSize, m_faceSize, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    mp_context->glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    mp_context->glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    mp_context->glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Filter across face edges so the seams don't show
+    mp_context->glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    // The cubemap stays on its own unit; everything else only uses unit 0
+    mp_context->glActiveTexture(GL_TEXTURE0);
+
+    mp_context->glGenFramebuffers(1, &m_fbo);
+    mp_context->printGLErrorLog();
+}
+
+void SkyCache::destroy() {
+    if (m_fbo != 0) {
+        mp_context->glDeleteFramebuffers(1, &m_fbo);
+        m_fbo = 0;
+    }
+    if (m_cubemap != 0) {
+        mp_context->glDeleteTextures(1, &m_cubemap);
+        m_cubemap = 0;
+    }
+    m_bakedTime = -1.f;
+}
+
+bool SkyCache::needsRefresh(float time) const {
+    return m_bakedTime < 0.f || time < m_bakedTime || time - m_bakedTime >= REFRESH_INTERVAL;
+}
+
+void SkyCache::refresh(Drawable &screenQuad, float time) {
+    // Each face's right, up and outward directions, as columns, following
+    // the GL cubemap convention for +X, -X, +Y, -Y, +Z, -Z
+    static const glm::mat3 faces[6] = {
+        glm::mat3(glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(1, 0, 0)),
+        glm::mat3(glm::vec3(0, 0, 1), glm::vec3(0, -1, 0), glm::vec3(-1, 0, 0)),
+        glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)),
+        glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0)),
+        glm::mat3(glm::vec3(1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1)),
+        glm::mat3(glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, -1))
+    };
+
+    // QOpenGLWidget draws into its own framebuffer, so put back
+    // whatever was bound rather than assuming it's 0
+    GLint previousFbo, viewport[4];
+    mp_context->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    mp_context->glGetIntegerv(GL_VIEWPORT, viewport);
+
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    mp_context->glViewport(0, 0, m_faceSize, m_faceSize);
+    mp_context->glDisable(GL_DEPTH_TEST);
+    mp_context->glDisable(GL_BLEND);
+
+    mp_bake->useMe();
+    mp_context->glUniform1f(unifFaceSize, static_cast<float>(m_faceSize));
+    for(int face = 0; face < 6; ++face) {
+        mp_context->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                           GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_cubemap, 0);
+        mp_context->glUniformMatrix3fv(unifFace, 1, GL_FALSE, &faces[face][0][0]);
+        mp_bake->draw(screenQuad);
+    }
+
+    mp_context->glEnable(GL_BLEND);
+    mp_context->glEnable(GL_DEPTH_TEST);
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    mp_context->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    mp_context->printGLErrorLog();
+
+    m_bakedTime = time;
+    ++m_refreshCount;
+}
+
+int SkyCache::refreshCount() const {
+    return m_refreshCount;
+}
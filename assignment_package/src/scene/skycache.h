@@ -0,0 +1,49 @@
+#pragma once
+#ifndef SKYCACHE_H
+#define SKYCACHE_H
+
+#include "openglcontext.h"
+#include "shaderprogram.h"
+#include "drawable.h"
+
+// The texture unit the sky cubemap stays bound to; unit 0 is the block atlas
+const int SKY_TEXTURE_SLOT = 1;
+
+// A small cubemap holding the sky in every direction. The expensive sky
+// shader only runs over its six faces, and only once the sun has moved
+// far enough to be noticed. Each frame the full-screen sky pass just
+// looks the view ray up in it, so the sky costs the same at any resolution.
+class SkyCache {
+private:
+    OpenGLContext *mp_context;
+    ShaderProgram *mp_bake;
+    int unifFace;
+    int unifFaceSize;
+
+    GLuint m_cubemap;
+    GLuint m_fbo;
+    int m_faceSize;
+    // The time the faces were last baked at, or negative if never
+    float m_bakedTime;
+    int m_refreshCount;
+
+public:
+    // Frames of u_Time between bakes. The sun turns 0.005 radians a frame,
+    // so this keeps it within about a degree of where it should be.
+    static const int REFRESH_INTERVAL = 4;
+
+    SkyCache(OpenGLContext *context, int faceSize = 128);
+
+    // bake must use skybake.frag.glsl
+    void create(ShaderProgram *bake);
+    void destroy();
+
+    bool needsRefresh(float time) const;
+    // Renders all six faces with the sky as it is at the given time.
+    // The frame uniforms must already hold that time.
+    void refresh(Drawable &screenQuad, float time);
+
+    int refreshCount() const;
+};
+
+#endif // SKYCACHE_H
@@ -1,26 +1,55 @@
 #include "terrain.h"
 #include "cube.h"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <thread>
+#include <chrono>
 #include <QDateTime>
+#include <QDir>
 #include "math.h"
 #include "river.h"
 
 Terrain::Terrain(OpenGLContext *context)
     : m_chunks(), m_generatedTerrain(), mp_context(context),
-      thread_pool(QThreadPool::globalInstance()), block_workers(),
-      vbo_workers(), gen_chunks(), chunk_mtx()
-{
-    // NOTE: remove unless needed
-    //thread_pool->setMaxThreadCount(25); // 25 threads available, one for each possible terrain generation zone
-}
+      m_jobs(), m_zoneJobs(), m_meshJobs(), m_uploads(context),
+      m_opaqueArena(context, 1 << 18), m_transArena(context, 1 << 15),
+      m_opaqueBatch(), m_transBatch(),
+      m_drawCandidates(), m_candidateBounds(), m_candidateVisible(), m_frustumCulled(0),
+      m_occlusionCuller(mkU<OcclusionCuller>()), m_occlusionRunning(false),
+      m_occlusionResult(), m_occluded(), m_occlusionCulled(0),
+      m_sectionQueue(), m_sectionEntries(), m_visibleSections(),
+      m_sectionGraphUsed(false), m_sectionsVisible(0), m_sectionCulled(0),
+      m_meshPending(), m_playerZone(0, 0), m_playerPos(0, 0),
+      m_grid(), m_gridLookups(0), m_mapLookups(0),
+      m_epochs(), m_chunkIndex(m_epochs), m_mainThread(std::this_thread::get_id()),
+      m_memoryBudget(512 * 1024 * 1024), m_unloadRadius(512), m_evictedZones(0), m_draining(),
+      m_coldClock(QDateTime::currentMSecsSinceEpoch()), m_lastColdScan(m_coldClock),
+      m_regions(), m_journal(), m_replay(), m_editsSinceCheckpoint(0),
+      m_checkpointId(0), m_checkpointing(),
+      m_io(context, m_regions, m_journal, [this](const sPtr<ZoneLoad> &zone) { submitZoneJob(zone); }),
+      gen_queue()
+{}
 
 Terrain::~Terrain() {
-    // Destroy all chunks
-    for (const auto &c : m_chunks) {
-        c.second->destroy();
-    }
+    // The I/O thread writes out the edits still in memory before it
+    // stops, and submits no more zones once it has
+    checkpoint();
+    m_io.shutdown();
+    // Nothing pops gen_queue from here on, so a worker waiting for
+    // room in it would keep the join below from ever returning
+    gen_queue.close();
+    // Workers hold pointers into this Terrain and its Chunks,
+    // so they must all be stopped before anything is freed
+    m_jobs.shutdown();
+    // Drops the meshes waiting to be uploaded, and with them the
+    // last ChunkRefs, before the chunks go
+    m_uploads.destroy();
+    m_regions.close();
+    m_journal.close();
+    // The chunks' meshes all live in the arenas
+    m_opaqueArena.destroy();
+    m_transArena.destroy();
 }
 
 // Combine two 32-bit ints into one 64-bit int
@@ -59,17 +88,21 @@ glm::ivec2 toCoords(int64_t k) {
 // the coordinates at x, y, z have a corresponding Chunk
 BlockType Terrain::getBlockAt(int x, int y, int z) const
 {
-    if(hasChunkAt(x, z)) {
+    // Keeps the Chunk alive should a worker be the one calling
+    EpochGuard guard(m_epochs);
+    Chunk *c = findChunk(x, z);
+    if(c != nullptr) {
+        if (onMainThread()) {
+            c->lastAccess = m_coldClock;
+        }
         // Just disallow action below or above min/max height,
         // but don't crash the game over it.
         if(y < 0 || y >= 256) {
             return EMPTY;
         }
-        const uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        return c->getBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
+        return c->getBlockAt(static_cast<unsigned int>(x & 15),
                              static_cast<unsigned int>(y),
-                             static_cast<unsigned int>(z - chunkOrigin.y));
+                             static_cast<unsigned int>(z & 15));
     }
     else {
         throw std::out_of_range("Coordinates " + std::to_string(x) +
@@ -82,42 +115,68 @@ BlockType Terrain::getBlockAt(glm::vec3 p) const {
     return getBlockAt(p.x, p.y, p.z);
 }
 
+Chunk* Terrain::findChunk(int x, int z) const {
+    // Shifting floors negative coordinates as well, so
+    // -1 lands in chunk -1 rather than chunk 0
+    int cx = x >> 4;
+    int cz = z >> 4;
+    if (!onMainThread()) {
+        return m_chunkIndex.find(cx, cz);
+    }
+    if (m_grid.contains(cx, cz)) {
+        ++m_gridLookups;
+        return m_grid.find(cx, cz);
+    }
+    ++m_mapLookups;
+    auto found = m_chunks.find(toKey(16 * cx, 16 * cz));
+    return found == m_chunks.end() ? nullptr : found->second.get();
+}
+
 bool Terrain::hasChunkAt(int x, int z) const {
-    // Map x and z to their nearest Chunk corner
-    // By flooring x and z, then multiplying by 16,
-    // we clamp (x, z) to its nearest Chunk-space corner,
-    // then scale back to a world-space location.
-    // Note that floor() lets us handle negative numbers
-    // correctly, as floor(-1 / 16.f) gives us -1, as
-    // opposed to (int)(-1 / 16.f) giving us 0 (incorrect!).
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks.find(toKey(16 * xFloor, 16 * zFloor)) != m_chunks.end();
+    return findChunk(x, z) != nullptr;
+}
+
+EpochManager& Terrain::epochs() {
+    return m_epochs;
+}
+
+bool Terrain::onMainThread() const {
+    return std::this_thread::get_id() == m_mainThread;
 }
 
 
 uPtr<Chunk>& Terrain::getChunkAt(int x, int z) {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks[toKey(16 * xFloor, 16 * zFloor)];
+    return m_chunks[toKey(16 * (x >> 4), 16 * (z >> 4))];
 }
 
 
 const uPtr<Chunk>& Terrain::getChunkAt(int x, int z) const {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks.at(toKey(16 * xFloor, 16 * zFloor));
+    return m_chunks.at(toKey(16 * (x >> 4), 16 * (z >> 4)));
 }
 
 void Terrain::setBlockAt(int x, int y, int z, BlockType t)
 {
-    if(hasChunkAt(x, z)) {
-        uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        c->setBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
+    if (!onMainThread()) {
+        throw std::runtime_error("Terrain::setBlockAt() is for the main thread only; "
+                                 "generators use setGeneratedBlockAt()");
+    }
+    Chunk *c = findChunk(x, z);
+    if(c != nullptr) {
+        c->lastAccess = m_coldClock;
+        // Whatever checkpoint is saving it has an old copy
+        m_checkpointing.erase(toKey(c->x_offset, c->z_offset));
+        BlockType before = c->getBlockAt(static_cast<unsigned int>(x & 15),
+                                         static_cast<unsigned int>(y),
+                                         static_cast<unsigned int>(z & 15));
+        c->setBlockAt(static_cast<unsigned int>(x & 15),
                       static_cast<unsigned int>(y),
-                      static_cast<unsigned int>(z - chunkOrigin.y),
+                      static_cast<unsigned int>(z & 15),
                       t);
+        c->modified = true;
+        if (m_journal.isOpen()) {
+            m_io.logEdit(BlockEdit{x, y, z, before, t});
+            ++m_editsSinceCheckpoint;
+        }
 //        c->create(); // TODO: Adjust code elsewhere so that create() need not be called every setBlockAt().
     }
     else {
@@ -127,35 +186,76 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
     }
 }
 
+void Terrain::setGeneratedBlockAt(int x, int y, int z, BlockType t)
+{
+    // Keeps the Chunk alive should a worker be the one calling
+    EpochGuard guard(m_epochs);
+    Chunk *c = findChunk(x, z);
+    if(c == nullptr) {
+        throw std::out_of_range("Coordinates " + std::to_string(x) +
+                                " " + std::to_string(y) + " " +
+                                std::to_string(z) + " have no Chunk!");
+    }
+    // Only the main thread may thaw a Chunk, and one that has gone cold
+    // is far from anything still being generated
+    if (c->isCold()) {
+        return;
+    }
+    c->setBlockAt(static_cast<unsigned int>(x & 15),
+                  static_cast<unsigned int>(y),
+                  static_cast<unsigned int>(z & 15),
+                  t);
+}
+
 std::unordered_set<int64_t> Terrain::getTerrainZones() {
     return m_generatedTerrain;
 }
 
-Chunk* Terrain::instantiateChunkAt(int x, int z) {
-    uPtr<Chunk> chunk = mkU<Chunk>(Chunk(mp_context));
+Chunk* Terrain::instantiateChunkAt(int x, int z, const sPtr<ZoneArena> &arena) {
+    uPtr<Chunk> chunk = mkU<Chunk>(mp_context, arena, ZoneArena::slotIndex(x, z));
     Chunk *cPtr = chunk.get();
-    m_chunks[toKey(x, z)] = move(chunk);
-    // Set the neighbor pointers of itself and its neighbors
-    if(hasChunkAt(x, z + 16)) {
-        auto &chunkNorth = m_chunks[toKey(x, z + 16)];
-        cPtr->linkNeighbor(chunkNorth, ZPOS);
-    }
-    if(hasChunkAt(x, z - 16)) {
-        auto &chunkSouth = m_chunks[toKey(x, z - 16)];
-        cPtr->linkNeighbor(chunkSouth, ZNEG);
-    }
-    if(hasChunkAt(x + 16, z)) {
-        auto &chunkEast = m_chunks[toKey(x + 16, z)];
-        cPtr->linkNeighbor(chunkEast, XPOS);
-    }
-    if(hasChunkAt(x - 16, z)) {
-        auto &chunkWest = m_chunks[toKey(x - 16, z)];
-        cPtr->linkNeighbor(chunkWest, XNEG);
-    }
+    cPtr->x_offset = x;
+    cPtr->z_offset = z;
+    cPtr->setArenas(&m_opaqueArena, &m_transArena);
+    storeChunk(std::move(chunk));
+    linkNeighbors(cPtr);
 
     return cPtr;
 }
 
+void Terrain::storeChunk(uPtr<Chunk> chunk) {
+    Chunk *c = chunk.get();
+    c->lastAccess = m_coldClock;
+    m_chunks[toKey(c->x_offset, c->z_offset)] = std::move(chunk);
+    m_chunkIndex.insert(c->x_offset >> 4, c->z_offset >> 4, c);
+    m_grid.set(c->x_offset >> 4, c->z_offset >> 4, c);
+}
+
+void Terrain::linkNeighbors(Chunk *c) {
+    int x = c->x_offset;
+    int z = c->z_offset;
+    const std::array<std::pair<glm::ivec2, Direction>, 4> neighbors {{
+        {glm::ivec2(x, z + 16), ZPOS},
+        {glm::ivec2(x, z - 16), ZNEG},
+        {glm::ivec2(x + 16, z), XPOS},
+        {glm::ivec2(x - 16, z), XNEG}
+    }};
+    // Set the neighbor pointers of itself and its neighbors
+    for(const auto &n : neighbors) {
+        if(hasChunkAt(n.first.x, n.first.y)) {
+            uPtr<Chunk> &neighbor = m_chunks[toKey(n.first.x, n.first.y)];
+            c->linkNeighbor(neighbor, n.second);
+            // A neighbor that was meshed without this Chunk next to it
+            // drew its faces along the shared border, so it needs another pass.
+            // meshNeighbors is set as soon as a mesh is built, so this
+            // also catches meshes still waiting to be uploaded.
+            if(neighbor->meshNeighbors != 0 && neighbor->meshNeighbors != neighbor->neighborMask()) {
+                m_meshPending.insert(toKey(n.first.x, n.first.y));
+            }
+        }
+    }
+}
+
 void Terrain::generateChunk(Chunk* c, int x_offset, int z_offset) {
     // Create the basic terrain floor
     for(int x = 0; x < 16; ++x) {
@@ -164,45 +264,316 @@ void Terrain::generateChunk(Chunk* c, int x_offset, int z_offset) {
         }
     }
     //c->setBlockAt(0, 180, 0, DIRT);
-    c->create();
+    // The VBO data is built by CreateTestScene() once
+    // every Chunk's neighbors have been generated
 }
 // NOTE: remove the generic terrain generation when other terrain generation is implemented
 void Terrain::expandChunks(const Player &player) {
     // Get the zone that the player is currently in
     int player_x = static_cast<int>(glm::floor(player.mcr_position[0] / 64.f) * 64);
     int player_z = static_cast<int>(glm::floor(player.mcr_position[2] / 64.f) * 64);
+    m_playerZone = glm::ivec2(player_x, player_z);
+    glm::vec2 pos(player.mcr_position[0], player.mcr_position[2]);
+    // Read ahead the saved region the player is heading into, a little
+    // beyond the zones about to be requested
+    if (m_regions.isOpen() && pos != m_playerPos) {
+        glm::vec2 ahead = pos + glm::normalize(pos - m_playerPos) * static_cast<float>(INTEREST_RADIUS + 64);
+        m_io.requestPrefetch(static_cast<int>(glm::floor(ahead.x)) >> 4, static_cast<int>(glm::floor(ahead.y)) >> 4);
+    }
+    m_playerPos = pos;
+
+    cancelStaleJobs();
+
+    // Keep the grid centred on the player, filling in
+    // whatever has come into it from the map
+    for(const glm::ivec2 &cell : m_grid.recenter(static_cast<int>(glm::floor(player.mcr_position[0])) >> 4,
+                                                 static_cast<int>(glm::floor(player.mcr_position[2])) >> 4)) {
+        auto found = m_chunks.find(toKey(16 * cell.x, 16 * cell.y));
+        if (found != m_chunks.end()) {
+            m_grid.set(cell.x, cell.y, found->second.get());
+        }
+    }
 
     // Add new terrain zones if needed
-    for(int x = -128; x <= 128; x += 64) {
-        for(int z = -128; z <= 128; z += 64) {
+    for(int x = -INTEREST_RADIUS; x <= INTEREST_RADIUS; x += 64) {
+        for(int z = -INTEREST_RADIUS; z <= INTEREST_RADIUS; z += 64) {
             int new_x = player_x + x;
             int new_z = player_z + z;
 
-            // If the key is not in the set, add it and generate the new terrain zone
+            // If the key is not in the set, add it and load or generate the new terrain zone
             uint64_t key = toKey(new_x, new_z);
             if (m_generatedTerrain.count(key) == 0) {
                m_generatedTerrain.insert(key);
-               // Spawn a worker thread to create the chunk and its blocks
-               block_workers.push_back(mkU<BlockTypeWorker>(BlockTypeWorker(mp_context, this, &chunk_mtx, new_x, new_z)));
-               thread_pool->start(block_workers.back().get());
-               // NOTE: the worker queue should be reset at some point, but since only the back is used
-               // it shouldn't create any immediate problems.
+               requestZone(new_x, new_z);
+            }
+        }
+    }
+}
+
+void Terrain::requestZone(int x, int z) {
+    JobHandle handle;
+    m_zoneJobs[toKey(x, z)] = handle;
+    sPtr<ZoneLoad> zone = mkS<ZoneLoad>(x, z, handle);
+    // Nothing can have been saved without a world to save it in
+    if (m_regions.isOpen()) {
+        m_io.requestLoad(zone);
+    } else {
+        submitZoneJob(zone);
+    }
+}
+
+void Terrain::submitZoneJob(const sPtr<ZoneLoad> &zone) {
+    int64_t key = toKey(zone->x, zone->z);
+    JobHandle handle = zone->handle;
+    // Spawn a job to create the chunks and their blocks
+    BlockTypeWorker worker(mp_context, this, zone);
+    m_jobs.submit(m_jobs.create(
+        [worker]() mutable { worker.run(); },
+        [this, key, handle]() {
+            // The zone may have been cancelled and resubmitted since
+            auto it = m_zoneJobs.find(key);
+            if (it != m_zoneJobs.end() && it->second == handle) {
+                m_zoneJobs.erase(it);
             }
+        },
+        handle));
+}
+
+bool Terrain::isZoneOfInterest(int x, int z) const {
+    return glm::abs(x - m_playerZone.x) <= INTEREST_RADIUS
+            && glm::abs(z - m_playerZone.y) <= INTEREST_RADIUS;
+}
+
+void Terrain::cancelStaleJobs() {
+    for(auto it = m_zoneJobs.begin(); it != m_zoneJobs.end();) {
+        glm::ivec2 zone = toCoords(it->first);
+        // If we won the race against the worker, its chunks will never be
+        // handed over, so forget the zone and let it be generated again
+        // should the player come back.
+        if (!isZoneOfInterest(zone.x, zone.y) && it->second.tryCancel()) {
+            m_generatedTerrain.erase(it->first);
+            it = m_zoneJobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for(auto it = m_meshJobs.begin(); it != m_meshJobs.end();) {
+        glm::ivec2 pos = toCoords(it->first);
+        int zone_x = static_cast<int>(glm::floor(pos.x / 64.f) * 64);
+        int zone_z = static_cast<int>(glm::floor(pos.y / 64.f) * 64);
+        if (!isZoneOfInterest(zone_x, zone_z) && it->second.tryCancel()) {
+            // Let updateVBOs() mesh it again if it comes back into range
+            getChunkAt(pos.x, pos.y)->generating = false;
+            m_meshPending.insert(it->first);
+            it = m_meshJobs.erase(it);
+        } else {
+            ++it;
         }
     }
 }
 
-void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram) {
+void Terrain::draw(int minX, int maxX, int minZ, int maxZ, const Camera &camera,
+                   ShaderProgram *shaderProgram, Texture *texture, RenderQueue &queue) {
+    Frustum frustum(camera.getViewProj());
+    m_drawCandidates.clear();
+    m_candidateBounds.clear();
     for(int x = minX; x < maxX; x += 16) {
         for(int z = minZ; z < maxZ; z += 16) {
-            if (hasChunkAt(x, z)) {
-               const uPtr<Chunk> &chunk = getChunkAt(x, z);
-               shaderProgram->setModelMatrix(glm::translate(glm::mat4(), glm::vec3(x, 0, z)));
-               shaderProgram->drawInterleavedTrans(*chunk, time);
-               shaderProgram->drawInterleavedOpaque(*chunk, time);
+            // Chunks still waiting on their first mesh have nothing to draw
+            if (hasChunkAt(x, z) && getChunkAt(x, z)->generated) {
+               Chunk *chunk = getChunkAt(x, z).get();
+               if (chunk->meshMinY > chunk->meshMaxY) {
+                   continue;
+               }
+               m_drawCandidates.push_back(chunk);
+               m_candidateBounds.add(chunk->bounds());
             }
         }
     }
+    int visible = frustum.cull(m_candidateBounds, m_candidateVisible);
+    m_frustumCulled = static_cast<int>(m_drawCandidates.size()) - visible;
+
+    bool useOcclusion = occlusionResultUsable(camera.mcr_position, camera.getForward());
+    m_sectionGraphUsed = findVisibleSections(minX, maxX, minZ, maxZ, camera, frustum);
+    m_occlusionCulled = 0;
+    m_sectionCulled = 0;
+    m_sectionsVisible = 0;
+    m_opaqueBatch.clear();
+    m_transBatch.clear();
+    for(size_t i = 0; i < m_drawCandidates.size(); ++i) {
+        if (m_candidateVisible[i]) {
+            Chunk *c = m_drawCandidates[i];
+            if (useOcclusion && m_occluded.count(toKey(c->x_offset, c->z_offset)) != 0) {
+                ++m_occlusionCulled;
+                continue;
+            }
+            if (!m_sectionGraphUsed) {
+                m_opaqueBatch.add(c->opaqueMesh());
+                m_transBatch.add(c->transMesh());
+                continue;
+            }
+            auto found = m_visibleSections.find(c);
+            if (found == m_visibleSections.end()) {
+                ++m_sectionCulled;
+                continue;
+            }
+            // Each run of visible sections is one contiguous range of indices
+            uint16_t mask = found->second;
+            const MeshSections &sec = c->sections;
+            int s = 0;
+            while (s < SECTION_COUNT) {
+                if (!(mask & (1 << s))) {
+                    ++s;
+                    continue;
+                }
+                int end = s;
+                while (end < SECTION_COUNT && (mask & (1 << end))) {
+                    ++m_sectionsVisible;
+                    ++end;
+                }
+                m_opaqueBatch.add(c->opaqueMesh(), sec.opaqueStarts[s], sec.opaqueStarts[end] - sec.opaqueStarts[s]);
+                m_transBatch.add(c->transMesh(), sec.transStarts[s], sec.transStarts[end] - sec.transStarts[s]);
+                s = end;
+            }
+        }
+    }
+    if (!m_occlusionRunning) {
+        startOcclusionJob(camera);
+    }
+
+    // Chunk vertices are already in world space. The batches are read when
+    // the queue is flushed, so they must not change until then.
+    queue.submit(PASS_OPAQUE, shaderProgram, texture, m_opaqueArena, m_opaqueBatch);
+    queue.submit(PASS_TRANSPARENT, shaderProgram, texture, m_transArena, m_transBatch);
+}
+
+bool Terrain::findVisibleSections(int minX, int maxX, int minZ, int maxZ, const Camera &camera, const Frustum &frustum) {
+    m_visibleSections.clear();
+    m_sectionEntries.clear();
+    m_sectionQueue.clear();
+
+    const glm::vec3 &eye = camera.mcr_position;
+    int eyeX = static_cast<int>(glm::floor(eye.x));
+    int eyeZ = static_cast<int>(glm::floor(eye.z));
+    int startSection = static_cast<int>(glm::floor(eye.y / 16.f));
+    if (startSection < 0 || startSection >= SECTION_COUNT || !hasChunkAt(eyeX, eyeZ)) {
+        return false;
+    }
+    Chunk *start = getChunkAt(eyeX, eyeZ).get();
+    if (!start->generated) {
+        return false;
+    }
+
+    m_sectionQueue.push_back(SectionStep{start, startSection, -1, 0});
+    m_sectionEntries[start].fill(0);
+    m_sectionEntries[start][startSection] = 0x3f;
+    // The queue only grows, so it doubles as the list of steps taken
+    for(size_t head = 0; head < m_sectionQueue.size(); ++head) {
+        SectionStep step = m_sectionQueue[head];
+        m_visibleSections[step.chunk] |= 1 << step.section;
+        uint64_t connectivity = step.chunk->sections.connectivity[step.section];
+
+        for(int d = 0; d < 6; ++d) {
+            // Never head back the way we came
+            if (step.traveled & (1 << (d ^ 1))) {
+                continue;
+            }
+            // Only leave through faces that can be seen from the way in
+            if (step.entry >= 0 && !(connectivity & (uint64_t(1) << (step.entry * 6 + d)))) {
+                continue;
+            }
+            Chunk *next = step.chunk;
+            int nextSection = step.section;
+            Direction dir = static_cast<Direction>(d);
+            if (dir == YPOS) {
+                ++nextSection;
+            } else if (dir == YNEG) {
+                --nextSection;
+            } else {
+                next = step.chunk->getNeighbor(dir);
+            }
+            if (next == nullptr || nextSection < 0 || nextSection >= SECTION_COUNT
+                    || next->x_offset < minX || next->x_offset >= maxX
+                    || next->z_offset < minZ || next->z_offset >= maxZ) {
+                continue;
+            }
+            // Chunks with no mesh yet are still walked through, since
+            // their default connectivity lets everything through
+            int entry = d ^ 1;
+            auto entries = m_sectionEntries.find(next);
+            if (entries == m_sectionEntries.end()) {
+                entries = m_sectionEntries.emplace(next, std::array<unsigned char, SECTION_COUNT>()).first;
+                entries->second.fill(0);
+            }
+            if (entries->second[nextSection] & (1 << entry)) {
+                continue;
+            }
+            entries->second[nextSection] |= 1 << entry;
+            glm::vec3 corner(next->x_offset, 16 * nextSection, next->z_offset);
+            if (!frustum.intersects(AABB{corner, corner + glm::vec3(16.f)})) {
+                continue;
+            }
+            m_sectionQueue.push_back(SectionStep{next, nextSection, entry,
+                                                 static_cast<unsigned char>(step.traveled | (1 << d))});
+        }
+    }
+    return true;
+}
+
+bool Terrain::occlusionResultUsable(const glm::vec3 &eye, const glm::vec3 &forward) const {
+    // Within a block and about three degrees. Turning can only bring in
+    // what was off screen, and isVisible() never hides that.
+    return m_occlusionResult != nullptr
+            && glm::distance(eye, m_occlusionResult->eye) < OCCLUSION_REUSE_DISTANCE
+            && glm::dot(forward, m_occlusionResult->forward) > 0.9986f;
+}
+
+void Terrain::startOcclusionJob(const Camera &camera) {
+    // Every chunk that passed the frustum test is both an occluder and
+    // something that might be hidden
+    sPtr<OcclusionJob> job = mkS<OcclusionJob>();
+    job->viewProj = camera.getViewProj();
+    job->eye = camera.mcr_position;
+    job->forward = camera.getForward();
+    job->ms = 0.f;
+    for(size_t i = 0; i < m_drawCandidates.size(); ++i) {
+        if (m_candidateVisible[i]) {
+            Chunk *c = m_drawCandidates[i];
+            c->appendOccluders(job->occluders);
+            job->bounds.push_back(c->bounds());
+            job->keys.push_back(toKey(c->x_offset, c->z_offset));
+        }
+    }
+    OcclusionCuller *culler = m_occlusionCuller.get();
+    m_occlusionRunning = true;
+    m_jobs.submit(m_jobs.create(
+        [job, culler]() {
+            auto start = std::chrono::steady_clock::now();
+            // Moving the eye by up to r moves everything else by as much
+            // relative to it, so hiding a box grown by r behind occluders
+            // shrunk by r hides the box itself from all of those eyes
+            glm::vec3 r(OCCLUSION_REUSE_DISTANCE);
+            culler->begin(job->viewProj);
+            for(const AABB &box : job->occluders) {
+                AABB shrunk{box.min + r, box.max - r};
+                if (glm::all(glm::lessThan(shrunk.min, shrunk.max))) {
+                    culler->rasterizeOccluder(shrunk);
+                }
+            }
+            culler->buildPyramid();
+            for(size_t i = 0; i < job->bounds.size(); ++i) {
+                if (!culler->isVisible(AABB{job->bounds[i].min - r, job->bounds[i].max + r})) {
+                    job->hidden.push_back(job->keys[i]);
+                }
+            }
+            job->ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        },
+        [this, job]() {
+            m_occlusionRunning = false;
+            m_occlusionResult = job;
+            m_occluded.clear();
+            m_occluded.insert(job->hidden.begin(), job->hidden.end());
+        }));
 }
 
 // Build the base 3x3 zones when the program is started
@@ -214,10 +585,14 @@ void Terrain::CreateTestScene() {
     for(int x = -64; x <= 64; x += 64) {
         for(int z = -64; z <= 64; z += 64) {
             m_generatedTerrain.insert(toKey(x, z));
+            sPtr<ZoneArena> arena = ZoneArena::create();
             for(int x2 = 0; x2 < 64; x2 += 16) {
                 for(int z2 = 0; z2 < 64; z2 += 16) {
-                    Chunk* c = instantiateChunkAt(x + x2, z + z2);
-                    generateChunk(c, x + x2, z + z2);
+                    Chunk* c = instantiateChunkAt(x + x2, z + z2, arena);
+                    if (!loadSavedChunk(c)) {
+                        generateChunk(c, x + x2, z + z2);
+                    }
+                    applyJournal(c);
                 }
             }
         }
@@ -234,55 +609,391 @@ void Terrain::CreateTestScene() {
 
 // Move chunks created from threads to the terrain chunk structure
 void Terrain::updateChunks() {
-    chunk_mtx.lock();
-    if (!gen_chunks.empty()) {
-        for(unsigned int i = 0; i < gen_chunks.size(); ++i) {
-            int x_offset = gen_chunks[i]->x_offset;
-            int z_offset = gen_chunks[i]->z_offset;
-            m_chunks[toKey(x_offset, z_offset)] = std::move(gen_chunks[i]);
-        }
-        gen_chunks.clear();
+    uPtr<Chunk> chunk;
+    while (gen_queue.tryPop(chunk)) {
+        int x_offset = chunk->x_offset;
+        int z_offset = chunk->z_offset;
+        Chunk *c = chunk.get();
+        c->setArenas(&m_opaqueArena, &m_transArena);
+        applyJournal(c);
+        storeChunk(std::move(chunk));
+        linkNeighbors(c);
+        m_meshPending.insert(toKey(x_offset, z_offset));
     }
-    chunk_mtx.unlock();
+}
+
+MPSCQueueStats Terrain::genQueueStats() const {
+    return gen_queue.stats();
 }
 
 void Terrain::updateVBOs() {
-    // First, check each terrain generation zone to see if its VBO data needs to be generated
-    for(int64_t key : m_generatedTerrain) {
-        glm::vec2 coord = toCoords(key);
-        // Check the chunks starting from this coordintes
-        for(int x = coord.x; x < coord.x + 64; x += 16) {
-            for(int z = coord.y; z < coord.y + 64; z += 16) {
-                // Check that the worker thread for this zone
-                // has finished; if a chunk is missing, assume
-                // the zone is not finished and stop initializing.
-                if (hasChunkAt(x,z)) {
-                    Chunk *c = getChunkAt(x,z).get();
-                    if (!c->generating && !c->generated) {
-                        vbo_workers.push_back(mkU<VBOWorker>(VBOWorker(c)));
-                        vbo_workers.back()->setAutoDelete(false);
-                        thread_pool->start(vbo_workers.back().get());
-                        c->generating = true;
-                    }
-                }
-                else {
-                    continue;
-                }
+    // Queue up the data of any meshing jobs that finished since the last
+    // tick, then buffer what fits in this frame, nearest chunks first
+    m_jobs.runCompletions();
+    m_uploads.uploadFrame(m_playerPos);
+
+    // Then start a meshing job for every out-of-date chunk whose
+    // neighbor halo is complete; the rest wait for their neighbors.
+    for(auto it = m_meshPending.begin(); it != m_meshPending.end();) {
+        glm::ivec2 pos = toCoords(*it);
+        Chunk *c = getChunkAt(pos.x, pos.y).get();
+        int zone_x = static_cast<int>(glm::floor(pos.x / 64.f) * 64);
+        int zone_z = static_cast<int>(glm::floor(pos.y / 64.f) * 64);
+        // A chunk that is already being meshed is checked
+        // again in finishMesh() when its job returns
+        if (c->generating || !c->hasAllNeighbors() || !isZoneOfInterest(zone_x, zone_z)) {
+            ++it;
+            continue;
+        }
+        // The worker reads the neighbors' border blocks as well, and
+        // can't thaw any of the five itself
+        for(Chunk *p : {c, c->getNeighbor(XPOS), c->getNeighbor(XNEG), c->getNeighbor(ZPOS), c->getNeighbor(ZNEG)}) {
+            p->thaw();
+            p->lastAccess = m_coldClock;
+        }
+        JobHandle handle;
+        m_meshJobs[*it] = handle;
+        // Holds references to all five, so they outlive the job
+        // even if they are evicted before it returns
+        sPtr<VBOWorker> worker = mkS<VBOWorker>(c, handle);
+        m_jobs.submit(m_jobs.create([worker]() { worker->run(); },
+                                    [this, worker]() { finishMesh(worker); },
+                                    handle));
+        c->generating = true;
+        it = m_meshPending.erase(it);
+    }
+}
+
+void Terrain::finishMesh(const sPtr<VBOWorker> &worker) {
+    Chunk *c = worker->getChunk();
+    int64_t key = toKey(c->x_offset, c->z_offset);
+    auto it = m_meshJobs.find(key);
+    if (it == m_meshJobs.end() || !(it->second == worker->getHandle())) {
+        // This job was cancelled, which cancelStaleJobs() has already dealt with
+        return;
+    }
+    m_meshJobs.erase(it);
+    c->generating = false;
+    if (worker->isCompleted()) {
+        // The chunk keeps drawing its old mesh (if any) until this is uploaded
+        m_uploads.enqueue(worker);
+        c->meshNeighbors = worker->getNeighborMask();
+    }
+    // Mesh again if a neighbor was linked while the job was running
+    if (!worker->isCompleted() || c->meshNeighbors != c->neighborMask()) {
+        m_meshPending.insert(key);
+    }
+}
+
+size_t Terrain::memoryEstimate() const {
+    size_t blocks = 0;
+    for(const auto &c : m_chunks) {
+        blocks += c.second->blockBytes();
+    }
+    // Zone arenas of evicted chunks count until they are reclaimed.
+    // The geometry arenas never shrink, but freed space is reused by
+    // the next meshes.
+    return m_chunks.size() * sizeof(Chunk) + blocks + ZoneArena::liveCount() * sizeof(ZoneArena)
+            + (m_opaqueArena.verticesUsed() + m_transArena.verticesUsed()) * GeometryArena::VERTEX_BYTES
+            + (m_opaqueArena.indicesUsed() + m_transArena.indicesUsed()) * sizeof(GLuint);
+}
+
+bool Terrain::canEvictZone(int x, int z) const {
+    if (m_zoneJobs.count(toKey(x, z)) != 0) {
+        return false;
+    }
+    for(int x2 = 0; x2 < 64; x2 += 16) {
+        for(int z2 = 0; z2 < 64; z2 += 16) {
+            auto found = m_chunks.find(toKey(x + x2, z + z2));
+            if (found != m_chunks.end() && found->second->modified && !m_regions.isOpen()) {
+                return false;
             }
         }
     }
-    // Check VBOWorkers to see if they have computed their VBO data; if so, send to GPU and delete worker
-    // NOTE: should probably use a mutex, but it hasn't created problems yet.w
-    for(unsigned int i = 0; i < vbo_workers.size(); ++i) {
-        if(vbo_workers[i]->isCompleted()) {
-            vbo_workers[i]->getChunk()->bufferData(vbo_workers[i]->getData().opaque_vertex, vbo_workers[i]->getData().opaque_index);
-            vbo_workers[i]->getChunk()->bufferDataTrans(vbo_workers[i]->getData().trans_vertex, vbo_workers[i]->getData().trans_index);
-            vbo_workers.erase(vbo_workers.begin() + i);
-            --i;
+    return true;
+}
+
+void Terrain::evictZone(int64_t key) {
+    glm::ivec2 zone = toCoords(key);
+    for(int x = zone.x; x < zone.x + 64; x += 16) {
+        for(int z = zone.y; z < zone.y + 64; z += 16) {
+            int64_t chunkKey = toKey(x, z);
+            auto found = m_chunks.find(chunkKey);
+            if (found == m_chunks.end()) {
+                continue;
+            }
+            Chunk *c = found->second.get();
+            if (c->modified) {
+                m_io.requestSave(*c);
+            }
+            // cancelStaleJobs() has cancelled any job still meshing it, and
+            // with it gone from m_meshJobs finishMesh() ignores the result
+            m_meshPending.erase(chunkKey);
+            m_meshJobs.erase(chunkKey);
+            m_occluded.erase(chunkKey);
+            m_checkpointing.erase(chunkKey);
+            m_uploads.discard(c);
+            c->unlinkNeighbors();
+            c->releaseMesh();
+            c->destroy();
+            m_grid.set(x >> 4, z >> 4, nullptr);
+            m_chunkIndex.erase(x >> 4, z >> 4);
+            uPtr<Chunk> owned = std::move(found->second);
+            m_chunks.erase(found);
+            retireChunk(std::move(owned));
+        }
+    }
+    // Regenerated from scratch should the player come back
+    m_generatedTerrain.erase(key);
+    ++m_evictedZones;
+}
+
+void Terrain::retireChunk(uPtr<Chunk> chunk) {
+    if (chunk->isReferenced()) {
+        m_draining.push_back(std::move(chunk));
+    } else {
+        // Nothing can take a new reference to it now it's out of the
+        // world, but a worker may still have found it in m_chunkIndex
+        Chunk *c = chunk.release();
+        m_epochs.retire([c]() { delete c; });
+    }
+}
+
+void Terrain::reclaimChunks() {
+    for(auto it = m_draining.begin(); it != m_draining.end();) {
+        if ((*it)->isReferenced()) {
+            ++it;
+        } else {
+            Chunk *c = it->release();
+            m_epochs.retire([c]() { delete c; });
+            it = m_draining.erase(it);
+        }
+    }
+    m_epochs.collect();
+}
+
+void Terrain::evictChunks() {
+    reclaimChunks();
+    // Zones still wanted are never candidates, however tight the budget
+    std::vector<std::pair<int, int64_t>> candidates;
+    for(int64_t key : m_generatedTerrain) {
+        glm::ivec2 zone = toCoords(key);
+        if (!isZoneOfInterest(zone.x, zone.y)) {
+            int distance = glm::max(glm::abs(zone.x - m_playerZone.x), glm::abs(zone.y - m_playerZone.y));
+            candidates.push_back(std::make_pair(distance, key));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<int, int64_t> &a, const std::pair<int, int64_t> &b) { return a.first > b.first; });
+
+    int evicted = 0;
+    size_t used = memoryEstimate();
+    for(const std::pair<int, int64_t> &zone : candidates) {
+        if (evicted == MAX_ZONE_EVICTIONS
+                || (zone.first <= m_unloadRadius && used <= m_memoryBudget)) {
+            break;
+        }
+        glm::ivec2 pos = toCoords(zone.second);
+        if (canEvictZone(pos.x, pos.y)) {
+            evictZone(zone.second);
+            ++evicted;
+            used = memoryEstimate();
+        }
+    }
+}
+
+void Terrain::freezeIdleChunks() {
+    m_coldClock = QDateTime::currentMSecsSinceEpoch();
+    if (m_coldClock - m_lastColdScan < COLD_SCAN_MS) {
+        return;
+    }
+    m_lastColdScan = m_coldClock;
+    int frozen = 0;
+    for(auto &entry : m_chunks) {
+        Chunk *c = entry.second.get();
+        if (c->isCold() || c->generating || c->isReferenced()
+                || m_coldClock - c->lastAccess < COLD_SECONDS * 1000) {
+            continue;
+        }
+        int zone_x = static_cast<int>(glm::floor(c->x_offset / 64.f) * 64);
+        int zone_z = static_cast<int>(glm::floor(c->z_offset / 64.f) * 64);
+        if (isZoneOfInterest(zone_x, zone_z)) {
+            continue;
+        }
+        c->freeze();
+        if (++frozen == MAX_FREEZES_PER_SCAN) {
+            break;
         }
     }
 }
 
-void Terrain::setTime(int t) {
-    time = t;
+bool Terrain::openWorld(const QString &dir) {
+    if (!m_regions.open(dir)) {
+        return false;
+    }
+    std::vector<BlockEdit> replay;
+    if (!m_journal.open(QDir(dir).filePath("edits.journal"), replay)) {
+        std::cerr << "Could not open the edit journal; edits will only be kept on eviction and exit" << std::endl;
+    }
+    for(const BlockEdit &e : replay) {
+        m_replay[toKey(16 * (e.x >> 4), 16 * (e.z >> 4))].push_back(e);
+    }
+    return true;
+}
+
+bool Terrain::loadSavedChunk(Chunk *c) {
+    return m_regions.load(c);
+}
+
+void Terrain::applyJournal(Chunk *c) {
+    auto found = m_replay.find(toKey(c->x_offset, c->z_offset));
+    if (found == m_replay.end()) {
+        return;
+    }
+    for(const BlockEdit &e : found->second) {
+        c->setBlockAt(static_cast<unsigned int>(e.x & 15), static_cast<unsigned int>(e.y),
+                      static_cast<unsigned int>(e.z & 15), e.after);
+    }
+    // Saved at the next checkpoint, which drops these from the journal
+    c->modified = true;
+    m_replay.erase(found);
+}
+
+void Terrain::checkpoint() {
+    if (!m_regions.isOpen()) {
+        return;
+    }
+    std::vector<const Chunk*> modified;
+    m_checkpointing.clear();
+    for(auto &c : m_chunks) {
+        if (c.second->modified) {
+            modified.push_back(c.second.get());
+            m_checkpointing.insert(c.first);
+        }
+    }
+    // Edits for chunks that haven't come back yet are only in the journal
+    std::vector<BlockEdit> carried;
+    for(const auto &edits : m_replay) {
+        carried.insert(carried.end(), edits.second.begin(), edits.second.end());
+    }
+    m_checkpointId = m_io.requestCheckpoint(modified, carried);
+    m_editsSinceCheckpoint = 0;
+}
+
+void Terrain::confirmCheckpoint(const CheckpointResult &result) {
+    // An earlier checkpoint's chunks are all in the latest one, unless
+    // they have changed since; the latest one's result settles them
+    if (result.id != m_checkpointId) {
+        return;
+    }
+    if (result.saved) {
+        for(int64_t key : m_checkpointing) {
+            auto found = m_chunks.find(key);
+            if (found != m_chunks.end()) {
+                found->second->modified = false;
+            }
+        }
+    }
+    // If not, they are still modified, and the next checkpoint tries again
+    m_checkpointing.clear();
+}
+
+void Terrain::persistEdits() {
+    for(const CheckpointResult &result : m_io.takeCheckpointResults()) {
+        confirmCheckpoint(result);
+    }
+    if (m_editsSinceCheckpoint >= CHECKPOINT_EDITS) {
+        checkpoint();
+    }
+}
+
+void Terrain::setEvictionLimits(size_t memoryBudget, int unloadRadius) {
+    m_memoryBudget = memoryBudget;
+    m_unloadRadius = unloadRadius;
+}
+
+void Terrain::setUploadBudget(size_t bytes, float ms) {
+    m_uploads.setByteBudget(bytes);
+    m_uploads.setTimeBudgetMs(ms);
+}
+
+UploadStats Terrain::uploadStats() const {
+    return m_uploads.stats();
+}
+
+void Terrain::printStats(std::ostream &out) {
+    MPSCQueueStats gen = genQueueStats();
+    JobStats jobs = m_jobs.stats();
+    UploadStats up = m_uploads.stats();
+    out << "Chunks: " << m_chunks.size() << " loaded, "
+        << m_zoneJobs.size() << " zones generating, "
+        << m_meshJobs.size() << " meshing, "
+        << m_meshPending.size() << " waiting to mesh" << std::endl;
+    out << "  memory: about " << memoryEstimate() / (1024 * 1024) << " MiB of "
+        << m_memoryBudget / (1024 * 1024) << " MiB budget, "
+        << m_evictedZones << " zones evicted so far" << std::endl;
+    out << "  zone arenas: " << ZoneArena::liveCount() << " live ("
+        << ZoneArena::liveCount() * sizeof(ZoneArena) / (1024 * 1024) << " MiB)" << std::endl;
+    EpochStats epochs = m_epochs.stats();
+    out << "  reclaim: " << m_draining.size() << " evicted chunks still held by jobs, "
+        << epochs.waiting << " retired awaiting readers, " << epochs.freed << "/" << epochs.retired
+        << " freed (epoch " << epochs.epoch << ")" << std::endl;
+    size_t cold = 0, packedBytes = 0;
+    for(const auto &c : m_chunks) {
+        if (c.second->isCold()) {
+            ++cold;
+            packedBytes += c.second->blockBytes();
+        }
+    }
+    ColdStats thaws = Chunk::coldStats();
+    Chunk::resetColdPeak();
+    out << "  cold: " << cold << " chunks packed into " << packedBytes / 1024 << " KiB ("
+        << (packedBytes == 0 ? 0.f : float(cold * sizeof(ChunkBlocks)) / packedBytes) << ":1), "
+        << thaws.freezes << " frozen and " << thaws.thaws << " thawed so far, "
+        << thaws.averageThawUs() << " us avg thaw (max " << thaws.maxThawNs / 1000.f << " us)" << std::endl;
+    RegionStats saved = m_regions.stats();
+    out << "  saves: " << saved.loads << " chunks loaded (" << saved.averageLoadUs() << " us avg), "
+        << saved.misses << " generated instead, " << saved.saves << " saved ("
+        << saved.bytesWritten / 1024 << " KiB), " << saved.compactions << " compactions, "
+        << saved.openRegions << " regions open" << std::endl;
+    ChunkIOStats io = m_io.stats();
+    out << "  io: " << io.zonesFromDisk << "/" << io.zonesRequested << " zones read whole from disk, "
+        << io.chunksLoaded << " chunks loaded, " << io.savesRequested << " saves in "
+        << io.saveBatches << " batches (" << io.savesCollapsed << " collapsed), "
+        << io.prefetches << " regions read ahead, " << io.pending << " pending, largest batch "
+        << io.maxBatch << std::endl;
+    out << "  journal: " << io.editsLogged << " edits in " << io.journalCommits << " commits, "
+        << io.checkpoints << " checkpoints (" << io.failedCheckpoints << " failed), " << m_editsSinceCheckpoint << " edits since the last" << std::endl;
+    ChunkMapStats index = m_chunkIndex.stats();
+    out << "  lookups: " << m_gridLookups << " through the grid, " << m_mapLookups << " through the map; index holds "
+        << index.chunks << "/" << index.capacity << " (" << index.tombstones << " tombstones), "
+        << index.rebuilds << " rebuilds" << std::endl;
+    m_gridLookups = m_mapLookups = 0;
+    out << "  gen_queue: depth " << gen.depth << " (max " << gen.maxDepth << "), "
+        << gen.averageResidencyMs() << " ms avg wait, "
+        << gen.producerStalls << " producer stalls" << std::endl;
+    out << "  jobs: " << jobs.executed << "/" << jobs.submitted << " run, "
+        << jobs.stolen << " stolen, start latency p50 " << jobs.latencyPercentileUs(0.5f)
+        << " us, p99 " << jobs.latencyPercentileUs(0.99f) << " us" << std::endl;
+    out << "  uploads: " << up.frameBytes / 1024 << " KiB last frame (peak "
+        << up.peakFrameBytes / 1024 << " KiB), backlog " << up.backlogChunks
+        << " chunks / " << up.backlogBytes / 1024 << " KiB, "
+        << up.stagingOrphans << " staging orphans" << std::endl;
+    out << "  draw: " << m_drawCandidates.size() - m_frustumCulled - m_occlusionCulled - m_sectionCulled << " chunks drawn, "
+        << m_frustumCulled << " outside the frustum, " << m_occlusionCulled << " occluded, "
+        << m_sectionCulled << " unreachable through caves ("
+        << m_opaqueBatch.size() << " opaque and " << m_transBatch.size() << " transparent meshes) last frame" << std::endl;
+    if (m_sectionGraphUsed) {
+        out << "  sections: " << m_sectionsVisible << " drawn, "
+            << m_sectionQueue.size() << " graph steps" << std::endl;
+    }
+    if (m_occlusionResult != nullptr) {
+        out << "  occlusion: " << m_occlusionResult->occluders.size() << " occluder boxes, "
+            << m_occlusionResult->hidden.size() << "/" << m_occlusionResult->bounds.size()
+            << " chunks hidden, " << m_occlusionResult->ms << " ms on a worker" << std::endl;
+    }
+    out << "  arenas: opaque " << m_opaqueArena.verticesUsed() << "/" << m_opaqueArena.vertexCapacity()
+        << " vertices, transparent " << m_transArena.verticesUsed() << "/" << m_transArena.vertexCapacity()
+        << " vertices, " << m_opaqueArena.growCount() + m_transArena.growCount() << " grows" << std::endl;
+    m_uploads.resetPeak();
 }
@@ -6,16 +6,28 @@ class Terrain;
 #include "smartpointerhelp.h"
 #include "glm_includes.h"
 #include "chunk.h"
+#include "chunkgrid.h"
+#include "chunkmap.h"
+#include "epochmanager.h"
+#include "zonearena.h"
+#include "regionfile.h"
+#include "editjournal.h"
 #include <array>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
-#include <QMutex>
-#include <QThreadPool>
 #include "shaderprogram.h"
+#include "renderqueue.h"
 #include "cube.h"
 #include "scene/player.h"
 #include "blocktypeworker.h"
+#include "chunkio.h"
 #include "vboworker.h"
+#include "jobsystem.h"
+#include "mpscqueue.h"
+#include "uploadscheduler.h"
+#include "occlusionculler.h"
+#include <ostream>
 
 // Helper functions to convert (x, z) to and from hash map key
 int64_t toKey(int x, int z);
@@ -45,35 +57,214 @@ private:
     // When milestone 1 has been implemented, the Player can move around the
     // world to add more "terrain generation zone" IDs to this set.
     // While only the 3 x 3 collection of terrain generation zones
-    // surrounding the Player should be rendered, the Chunks
-    // in the Terrain will never be deleted until the program is terminated.
+    // surrounding the Player should be rendered, the Chunks of a zone
+    // are only deleted once evictChunks() finds the Player has left it
+    // far enough behind, after which it is generated again on return.
     std::unordered_set<int64_t> m_generatedTerrain;
 
     OpenGLContext* mp_context;
 
-    QThreadPool* thread_pool;
-    std::vector< uPtr<BlockTypeWorker> > block_workers;
-    std::vector< uPtr<VBOWorker> > vbo_workers;
+    // Runs chunk generation and meshing off the main thread
+    JobSystem m_jobs;
+    // Generation jobs still in flight, keyed by terrain generation zone
+    std::unordered_map<int64_t, JobHandle> m_zoneJobs;
+    // Meshing jobs still in flight, keyed by Chunk
+    std::unordered_map<int64_t, JobHandle> m_meshJobs;
+    // Called on the main thread once a VBOWorker's job has finished
+    void finishMesh(const sPtr<VBOWorker> &worker);
+    // Finished meshes waiting for their turn to be sent to the GPU
+    UploadScheduler m_uploads;
+    // Every Chunk's opaque and transparent meshes, packed together so
+    // each can be drawn in one call
+    GeometryArena m_opaqueArena;
+    GeometryArena m_transArena;
+    // Reused by draw() so its vectors aren't reallocated every frame
+    MultiDrawBatch m_opaqueBatch;
+    MultiDrawBatch m_transBatch;
+    // Chunks in the draw area, their bounds, and which of them are on screen
+    std::vector<Chunk*> m_drawCandidates;
+    AABBBatch m_candidateBounds;
+    std::vector<unsigned char> m_candidateVisible;
+    int m_frustumCulled;
 
-    int time;
+    // Occlusion culling runs on a worker, one frame behind: each frame's
+    // frustum-visible chunks are handed to a job, and the ones it finds
+    // hidden are skipped in later frames for as long as the camera stays
+    // close to where it was when the job started. So that stays sound,
+    // the job shrinks its occluders and grows the chunks' bounds by
+    // OCCLUSION_REUSE_DISTANCE: whatever is hidden then is hidden from
+    // every eye within that distance.
+    struct OcclusionJob {
+        glm::mat4 viewProj;
+        glm::vec3 eye;
+        glm::vec3 forward;
+        std::vector<AABB> occluders;
+        std::vector<AABB> bounds;
+        std::vector<int64_t> keys;
+        std::vector<int64_t> hidden;  // Filled in by the worker
+        float ms;
+    };
+    // Only ever touched by the one job in flight
+    uPtr<OcclusionCuller> m_occlusionCuller;
+    bool m_occlusionRunning;
+    // The last finished job's results
+    sPtr<OcclusionJob> m_occlusionResult;
+    std::unordered_set<int64_t> m_occluded;
+    int m_occlusionCulled;
+    static constexpr float OCCLUSION_REUSE_DISTANCE = 1.f;
+    // Can chunks hidden from the last job's viewpoint be skipped from this one?
+    bool occlusionResultUsable(const glm::vec3 &eye, const glm::vec3 &forward) const;
+    void startOcclusionJob(const Camera &camera);
+
+    // Cave culling: a breadth-first walk out from the camera's section that
+    // only passes through a section between faces its see-through blocks
+    // connect, and never doubles back. Sections it can't reach are hidden
+    // behind solid rock and aren't drawn.
+    struct SectionStep {
+        Chunk *chunk;
+        int section;
+        int entry;              // Face it was entered through, or -1 at the start
+        unsigned char traveled; // Directions taken to get here
+    };
+    std::vector<SectionStep> m_sectionQueue;
+    // Faces each section has already been entered through
+    std::unordered_map<const Chunk*, std::array<unsigned char, SECTION_COUNT>> m_sectionEntries;
+    // Which sections of each reached chunk can be seen
+    std::unordered_map<const Chunk*, uint16_t> m_visibleSections;
+    bool m_sectionGraphUsed;
+    int m_sectionsVisible;
+    int m_sectionCulled;
+    // Fills in m_visibleSections. Returns false if the camera isn't inside
+    // a meshed chunk, in which case every section should be drawn.
+    bool findVisibleSections(int minX, int maxX, int minZ, int maxZ, const Camera &camera, const Frustum &frustum);
+
+    // Chunks whose VBO data is missing or out of date. A Chunk stays in
+    // here until all four of its neighbors exist, so that faces on its
+    // border are culled against real data; it is added again if a
+    // neighbor turns up after it was meshed.
+    std::unordered_set<int64_t> m_meshPending;
+    // Links c to the Chunks around it, and marks any already-meshed
+    // neighbor that was missing c as needing a new mesh
+    void linkNeighbors(Chunk *c);
+
+    // Lower-left corner of the terrain generation zone the player was in
+    // at the last expandChunks() tick. Zones further than
+    // INTEREST_RADIUS blocks from it (on either axis) are not worth
+    // generating or meshing.
+    glm::ivec2 m_playerZone;
+    // The player's x-z position at the last expandChunks() tick
+    glm::vec2 m_playerPos;
+    static const int INTEREST_RADIUS = 128;
+    bool isZoneOfInterest(int x, int z) const;
+    // Cancels every queued or running job for zones the player has left
+    void cancelStaleJobs();
+
+    // Direct lookup for the chunks around the player; m_chunks is only
+    // searched for chunks outside it
+    ChunkGrid m_grid;
+    mutable uint64_t m_gridLookups;
+    mutable uint64_t m_mapLookups;
+    // Evicted chunks, and tables m_chunkIndex has outgrown, are only
+    // freed once no worker can still be using them
+    mutable EpochManager m_epochs;
+    // Every Chunk in m_chunks again, for worker threads, which must touch
+    // neither m_chunks nor m_grid; findChunk() uses it on any thread but
+    // the one that made this Terrain
+    ChunkMap m_chunkIndex;
+    std::thread::id m_mainThread;
+    bool onMainThread() const;
+    // Stores c in m_chunks, m_chunkIndex and, if it's near the player, in m_grid
+    void storeChunk(uPtr<Chunk> chunk);
+
+    // Zones outside INTEREST_RADIUS are unloaded, farthest first, once
+    // they are more than m_unloadRadius blocks away or the loaded chunks
+    // are estimated to take up more than m_memoryBudget bytes.
+    size_t m_memoryBudget;
+    int m_unloadRadius;
+    uint64_t m_evictedZones;
+    // Only a few zones are unloaded per tick, so a long flight
+    // doesn't end in one long frame
+    static const int MAX_ZONE_EVICTIONS = 2;
+    // Block storage, in zone arenas or not, plus the space taken in
+    // the geometry arenas
+    size_t memoryEstimate() const;
+    // A zone can't go while it is still being generated, or while it
+    // holds edits that would be lost because no world is open to save
+    // them to. Meshing jobs don't hold it back; see retireChunk().
+    bool canEvictZone(int x, int z) const;
+    // Evicted chunks that jobs still hold ChunkRefs to
+    std::vector<uPtr<Chunk>> m_draining;
+    // Frees an evicted Chunk once no job holds it and no worker can have
+    // found it in m_chunkIndex
+    void retireChunk(uPtr<Chunk> chunk);
+    // Moves drained chunks on to m_epochs, then frees what it can
+    void reclaimChunks();
+
+    // Chunks outside INTEREST_RADIUS whose blocks haven't been touched for
+    // COLD_SECONDS are frozen (see Chunk::freeze()), a few per scan, so
+    // far more of the explored world fits in m_memoryBudget
+    static const int COLD_SECONDS = 30;
+    static const int COLD_SCAN_MS = 1000;
+    static const int MAX_FREEZES_PER_SCAN = 32;
+    // Milliseconds, refreshed once a tick; what Chunk::lastAccess is read against
+    int64_t m_coldClock;
+    int64_t m_lastColdScan;
+
+    // Where edited chunks are saved and loaded from
+    RegionStore m_regions;
+    // Every edit since the last checkpoint, so none are lost in a crash
+    EditJournal m_journal;
+    // Edits read from the journal at startup for chunks that haven't
+    // been loaded yet, oldest first, keyed by Chunk
+    std::unordered_map<int64_t, std::vector<BlockEdit>> m_replay;
+    int m_editsSinceCheckpoint;
+    // The latest checkpoint requested, and the chunks it is saving. A
+    // Chunk stays modified until the I/O thread confirms its save landed,
+    // and drops out of the set if it is edited or evicted before then.
+    uint64_t m_checkpointId;
+    std::unordered_set<int64_t> m_checkpointing;
+    // Clears modified on the chunks a checkpoint saved, if it succeeded
+    void confirmCheckpoint(const CheckpointResult &result);
+    // How many edits the journal may take before a checkpoint
+    // empties it of everything but m_replay
+    static const int CHECKPOINT_EDITS = 4096;
+    // Reapplies c's journaled edits, if it has any
+    void applyJournal(Chunk *c);
+    // Every read and write of m_regions after startup goes through here
+    ChunkIO m_io;
+    // Brings a zone into the world. Its saved chunks are read on the
+    // I/O thread, then a worker generates whatever wasn't saved.
+    void requestZone(int x, int z);
+    // Starts the worker for a zone. Called from the I/O thread as well.
+    void submitZoneJob(const sPtr<ZoneLoad> &zone);
+    // Saves the zone's edited chunks, then retires them all
+    void evictZone(int64_t key);
 
 public:
     Terrain(OpenGLContext *context);
     ~Terrain();
 
     std::unordered_map<int64_t, uPtr<Chunk>> m_chunks;
-    // Stores the chunks generated by threads;
+    // Hands the chunks generated by threads to the main thread.
+    // Workers push without locking and updateChunks() drains it without
+    // ever blocking; a full 5 x 5 ring of zones fits in it at once.
     // Public for workers to easily access
-    std::vector< uPtr<Chunk> > gen_chunks;
-    // Mutex for gen_chunks
-    QMutex chunk_mtx;
+    MPSCQueue<uPtr<Chunk>, 512> gen_queue;
 
     // Instantiates a new Chunk and stores it in
     // our chunk map at the given coordinates.
     // Returns a pointer to the created Chunk.
-    Chunk* instantiateChunkAt(int x, int z);
+    // Its blocks go in its slot of arena, if one is given.
+    Chunk* instantiateChunkAt(int x, int z, const sPtr<ZoneArena> &arena = nullptr);
+    // The Chunk containing these world-space coordinates,
+    // or nullptr if there isn't one. Safe to call from workers, though
+    // they must be inside an EpochGuard on epochs() for as long as they
+    // use the result, and only the main thread may change a Chunk that
+    // is in the world.
+    Chunk* findChunk(int x, int z) const;
+    EpochManager& epochs();
     // Do these world-space coordinates lie within
-    // a Chunk that exists?
+    // a Chunk that exists? Safe to call from workers.
     bool hasChunkAt(int x, int z) const;
     // Assuming a Chunk exists at these coords,
     // return a mutable reference to it
@@ -83,29 +274,54 @@ public:
     const uPtr<Chunk>& getChunkAt(int x, int z) const;
     // Given a world-space coordinate (which may have negative
     // values) return the block stored at that point in space.
+    // Reading or writing a block thaws its Chunk if it was cold.
     BlockType getBlockAt(int x, int y, int z) const;
     BlockType getBlockAt(glm::vec3 p) const;
     // Given a world-space coordinate (which may have negative
     // values) set the block at that point in space to the
-    // given type.
+    // given type. This is a player edit: it is journaled and the Chunk
+    // is saved. Main thread only; throws std::runtime_error elsewhere.
     void setBlockAt(int x, int y, int z, BlockType t);
+    // The same for terrain generation, such as River, which is neither
+    // journaled nor saved since generating again reproduces it. Safe to
+    // call from workers. Cold chunks are left alone.
+    void setGeneratedBlockAt(int x, int y, int z, BlockType t);
     void recreateChunk(int x, int y);
 
     std::unordered_set<int64_t> getTerrainZones();
 
-    void setTime(int t);
-
     // Fills chunk with procedural height field data
     void generateChunk(Chunk* c, int x_offset, int z_offset);
 
     // Updates the chunks that are rendered based on how close
-    // the player is to them.
+    // the player is to them, and cancels any generation or meshing
+    // work for zones that have fallen out of range.
     void expandChunks(const Player &player);
 
-    // Draws every Chunk that falls within the bounding box
-    // described by the min and max coords, using the provided
-    // ShaderProgram
-    void draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram);
+    // Queues every Chunk that falls within the bounding box
+    // described by the min and max coords, to be drawn with the provided
+    // ShaderProgram and texture. Chunks outside the view frustum are skipped;
+    // all other opaque meshes go in one draw call and all
+    // transparent ones in another.
+    // Chunks found hidden by the last occlusion culling job are also skipped,
+    // as are sections that can't be seen through the caves around the camera.
+    void draw(int minX, int maxX, int minZ, int maxZ, const Camera &camera,
+              ShaderProgram *shaderProgram, Texture *texture, RenderQueue &queue);
+
+    // Chunks the player has edited are saved to region files in dir, and
+    // loaded back in place of generating them. Edits are also journaled
+    // there as they happen; any left by the last run are read back here
+    // and applied to their chunks as they arrive.
+    bool openWorld(const QString &dir);
+    // Fills a newly made Chunk from the open world, if it was saved there.
+    // Reads from disk on the calling thread.
+    bool loadSavedChunk(Chunk *c);
+    // Queues every edited Chunk still loaded to be written to the open
+    // world, after which the journal is started over
+    void checkpoint();
+    // Confirms finished checkpoints, then checkpoints again once enough
+    // edits have been journaled since the last one
+    void persistEdits();
 
     // Renders the initial 3x3 terrain generation zone before multithreading
     void CreateTestScene();
@@ -113,7 +329,26 @@ public:
 
     // Move chunks created from threads to the terrain chunk structure
     void updateChunks();
+    // Depth and wait-time counters for gen_queue
+    MPSCQueueStats genQueueStats() const;
 
-    // Checks the chunks in the generated zones and creates VBOWorker threads if they don't exist
+    // Unloads distant zones to stay within the unload radius and memory
+    // budget, and frees those evicted earlier once nothing is using
+    // them. The GL context must be current.
+    void evictChunks();
+    void setEvictionLimits(size_t memoryBudget, int unloadRadius);
+    // Packs the blocks of chunks that have sat idle out of the player's way
+    void freezeIdleChunks();
+
+    // Starts VBOWorker jobs for chunks whose neighbors have all been generated
+    // and whose VBO data is missing or out of date, then uploads as many
+    // finished meshes as this frame's budget allows
     void updateVBOs();
+    // How much chunk data may be sent to the GPU in a single frame
+    void setUploadBudget(size_t bytes, float ms);
+    UploadStats uploadStats() const;
+
+    // Writes the streaming counters (queues, jobs, uploads) to out and
+    // resets the per-report peaks
+    void printStats(std::ostream &out);
 };
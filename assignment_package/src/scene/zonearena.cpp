@@ -0,0 +1,30 @@
+#include "zonearena.h"
+
+std::atomic<int> ZoneArena::s_live(0);
+
+ZoneArena::ZoneArena()
+    : m_blocks()
+{
+    s_live.fetch_add(1, std::memory_order_relaxed);
+}
+
+sPtr<ZoneArena> ZoneArena::create() {
+    return sPtr<ZoneArena>(new ZoneArena());
+}
+
+ZoneArena::~ZoneArena() {
+    s_live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+ChunkBlocks& ZoneArena::slot(int index) {
+    return m_blocks[index];
+}
+
+int ZoneArena::slotIndex(int x, int z) {
+    // Masking finds the offset within the zone for negative coordinates too
+    return 4 * ((x & 63) >> 4) + ((z & 63) >> 4);
+}
+
+int ZoneArena::liveCount() {
+    return s_live.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef ZONEARENA_H
+#define ZONEARENA_H
+
+#include "chunk.h"
+#include "smartpointerhelp.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Block storage for the 16 chunks of one terrain generation zone, in a
+// single 1 MiB allocation. A zone's chunks are made, meshed against each
+// other and evicted together, so keeping their blocks side by side
+// saves 15 allocations per zone and keeps cross-chunk reads close.
+// Each Chunk built on a slot shares ownership of the arena, which is
+// freed in one go once the last of them is: when the zone is evicted,
+// or once all of them have gone cold. So freezing only gives memory back
+// a whole zone at a time. A Chunk thawed while its arena is still alive
+// decodes back into its own slot; after that it gets an array of its own.
+class ZoneArena {
+public:
+    static const int CHUNKS = 16;
+
+private:
+    std::array<ChunkBlocks, CHUNKS> m_blocks;
+    // Arenas alive right now, across all threads
+    static std::atomic<int> s_live;
+
+public:
+    // Every block of every slot starts out EMPTY
+    ZoneArena();
+    // Always make arenas with this rather than mkS. Cold chunks keep weak
+    // pointers to theirs, and with mkS's single allocation those would
+    // keep the whole megabyte from being freed.
+    static sPtr<ZoneArena> create();
+    ~ZoneArena();
+    ZoneArena(const ZoneArena&) = delete;
+    ZoneArena& operator=(const ZoneArena&) = delete;
+
+    ChunkBlocks& slot(int index);
+    // The slot for the Chunk whose lower-left corner is at these
+    // world coordinates: 4 * (x / 16) + (z / 16) within its zone
+    static int slotIndex(int x, int z);
+
+    static int liveCount();
+};
+
+#endif // ZONEARENA_H
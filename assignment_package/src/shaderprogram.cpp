@@ -12,11 +12,14 @@ ShaderProgram::ShaderProgram(OpenGLContext *context)
       attrPos(-1), attrNor(-1), attrCol(-1), attrUV(-1), animate(-1),
       unifModel(-1), unifModelInvTr(-1), unifViewProj(-1), unifColor(-1), unifTexture(-1), unifTime(-1),
       unifDimensions(-1), unifEye(-1),
-      context(context)
+      context(context), m_normalMatrixIsIdentity(false)
 {}
 
 void ShaderProgram::create(const char *vertfile, const char *fragfile)
 {
+    // A new program's u_ModelInvTr starts out all zeros, whatever the
+    // old one had, so the first model matrix must upload it
+    m_normalMatrixIsIdentity = false;
     // Allocate space on our GPU for a vertex shader and a fragment shader and a shader program to manage the two
     vertShader = context->glCreateShader(GL_VERTEX_SHADER);
     fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
@@ -51,6 +54,11 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
     // Tell prog that it manages these particular vertex and fragment shaders
     context->glAttachShader(prog, vertShader);
     context->glAttachShader(prog, fragShader);
+    // Fix the attribute locations so VAOs don't depend on the program
+    context->glBindAttribLocation(prog, ATTR_POS, "vs_Pos");
+    context->glBindAttribLocation(prog, ATTR_COL, "vs_Col");
+    context->glBindAttribLocation(prog, ATTR_NOR, "vs_Nor");
+    context->glBindAttribLocation(prog, ATTR_UV, "vs_UV");
     context->glLinkProgram(prog);
 
     // Check for linking success
@@ -76,11 +84,23 @@ void ShaderProgram::create(const char *vertfile, const char *fragfile)
     unifTexture = context->glGetUniformLocation(prog, "u_Texture");
     unifTime = context->glGetUniformLocation(prog, "u_Time");
     unifDimensions = context->glGetUniformLocation(prog, "u_Dimensions");
+
+    // The view-projection matrix, eye, time and screen size all come from
+    // the shared per-frame uniform buffer
+    GLuint frameBlock = context->glGetUniformBlockIndex(prog, "FrameUniforms");
+    if (frameBlock != GL_INVALID_INDEX) {
+        context->glUniformBlockBinding(prog, frameBlock, FRAME_UNIFORM_BINDING);
+    }
 }
 
 void ShaderProgram::useMe()
 {
-    context->glUseProgram(prog);
+    context->useProgram(prog);
+}
+
+// Does model leave directions (and so normals) unchanged?
+static bool isTranslation(const glm::mat4 &model) {
+    return glm::mat3(model) == glm::mat3();
 }
 
 void ShaderProgram::setModelMatrix(const glm::mat4 &model)
@@ -99,7 +119,16 @@ void ShaderProgram::setModelMatrix(const glm::mat4 &model)
                            &model[0][0]);
     }
 
-    if (unifModelInvTr != -1) {
+    if (unifModelInvTr != -1 && isTranslation(model)) {
+        // Only the upper 3x3 of the normal matrix is used, and for a
+        // translation that's the identity, so there's nothing to invert
+        if (!m_normalMatrixIsIdentity) {
+            glm::mat4 identity;
+            context->glUniformMatrix4fv(unifModelInvTr, 1, GL_FALSE, &identity[0][0]);
+            m_normalMatrixIsIdentity = true;
+        }
+    } else if (unifModelInvTr != -1) {
+        m_normalMatrixIsIdentity = false;
         glm::mat4 modelinvtr = glm::inverse(glm::transpose(model));
         // Pass a 4x4 matrix into a uniform variable in our shader
                         // Handle to the matrix variable on the GPU
@@ -166,6 +195,7 @@ void ShaderProgram::setTime(int t) {
 void ShaderProgram::draw(Drawable &d)
 {
     useMe();
+    d.bindVAO();
 
     if(d.elemCount() < 0) {
         throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
@@ -210,6 +240,7 @@ void ShaderProgram::draw(Drawable &d)
 // Draw the given object to our screen using this ShaderProgram's shaders (interleaved version)
 void ShaderProgram::drawInterleaved(Drawable &d) {
     useMe();
+    d.bindVAO();
 
     if(d.elemCount() < 0) {
         throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
@@ -256,6 +287,7 @@ void ShaderProgram::drawInterleaved(Drawable &d) {
 
 void ShaderProgram::drawInterleavedOpaque(Drawable &d, int t){
     useMe();
+    d.bindVAO();
 
     if(d.elemCount() < 0) {
         throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
@@ -307,6 +339,7 @@ void ShaderProgram::drawInterleavedOpaque(Drawable &d, int t){
 
 void ShaderProgram::drawInterleavedTrans(Drawable &d, int t){
     useMe();
+    d.bindVAO();
 
     if(d.elemTransCount() < 0) {
         throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
@@ -356,6 +389,20 @@ void ShaderProgram::drawInterleavedTrans(Drawable &d, int t){
 
 }
 
+void ShaderProgram::drawMultiInterleaved(GeometryArena &arena, const MultiDrawBatch &batch) {
+    if (batch.size() == 0) {
+        return;
+    }
+    useMe();
+
+    // The arena's VAO already has its attributes and index buffer set up
+    arena.bind();
+    context->glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), GL_UNSIGNED_INT,
+                                           batch.indexOffsets.data(), batch.size(), batch.baseVertices.data());
+
+    context->printGLErrorLog();
+}
+
 char* ShaderProgram::textFileRead(const char* fileName) {
     char* text;
 
@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 
 #include "drawable.h"
+#include "geometryarena.h"
+#include "uniformbuffer.h"
 
 
 class ShaderProgram
@@ -37,7 +39,8 @@ public:
     void create(const char *vertfile, const char *fragfile);
     // Tells our OpenGL context to use this shader to draw things
     void useMe();
-    // Pass the given model matrix to this shader on the GPU
+    // Pass the given model matrix to this shader on the GPU. If it is only
+    // a translation, the normal matrix is the identity and isn't recomputed.
     void setModelMatrix(const glm::mat4 &model);
     // Pass the given Projection * View matrix to this shader on the GPU
     void setViewProjMatrix(const glm::mat4 &vp);
@@ -52,6 +55,9 @@ public:
     void drawInterleaved(Drawable &d);
     void drawInterleavedOpaque(Drawable &d, int t);
     void drawInterleavedTrans(Drawable &d, int t);
+    // Draw every mesh in the batch, all stored in the given arena, with
+    // one glMultiDrawElementsBaseVertex call
+    void drawMultiInterleaved(GeometryArena &arena, const MultiDrawBatch &batch);
     // Utility function used in create()
     char* textFileRead(const char*);
     // Utility function that prints any shader compilation errors to the console
@@ -65,6 +71,8 @@ private:
     OpenGLContext* context;   // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                             // we need to pass our OpenGL context to the Drawable in order to call GL functions
                             // from within this class.
+    // Whether u_ModelInvTr currently holds the identity
+    bool m_normalMatrixIsIdentity;
 };
 
 
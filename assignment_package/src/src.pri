@@ -3,16 +3,28 @@ DEPENDPATH += $$PWD
 
 SOURCES += \
     $$PWD/blocktypeworker.cpp \
+    $$PWD/chunkio.cpp \
     $$PWD/main.cpp \
     $$PWD/mainwindow.cpp \
     $$PWD/mygl.cpp \
     $$PWD/scene/river.cpp \
     $$PWD/scene/sky.cpp \
+    $$PWD/scene/skycache.cpp \
     $$PWD/scene/turtle.cpp \
     $$PWD/shaderprogram.cpp \
+    $$PWD/stagingring.cpp \
     $$PWD/drawable.cpp \
+    $$PWD/freelistallocator.cpp \
+    $$PWD/frustum.cpp \
+    $$PWD/gameloop.cpp \
+    $$PWD/geometryarena.cpp \
+    $$PWD/jobbenchmark.cpp \
+    $$PWD/jobhandle.cpp \
+    $$PWD/jobsystem.cpp \
     $$PWD/cameracontrolshelp.cpp \
     $$PWD/scene/cube.cpp \
+    $$PWD/occlusionculler.cpp \
+    $$PWD/renderqueue.cpp \
     $$PWD/openglcontext.cpp \
     $$PWD/scene/terrain.cpp \
     $$PWD/scene/worldaxes.cpp \
@@ -21,20 +33,41 @@ SOURCES += \
     $$PWD/scene/camera.cpp \
     $$PWD/playerinfo.cpp \
     $$PWD/scene/chunk.cpp \
+    $$PWD/scene/chunkgrid.cpp \
+    $$PWD/scene/chunkmap.cpp \
+    $$PWD/scene/regionfile.cpp \
+    $$PWD/scene/blockcodec.cpp \
+    $$PWD/scene/editjournal.cpp \
+    $$PWD/scene/zonearena.cpp \
     $$PWD/texture.cpp \
+    $$PWD/uniformbuffer.cpp \
+    $$PWD/uploadscheduler.cpp \
     $$PWD/vboworker.cpp
 
 HEADERS += \
     $$PWD/blocktypeworker.h \
+    $$PWD/chunkio.h \
     $$PWD/mainwindow.h \
     $$PWD/mygl.h \
     $$PWD/scene/river.h \
     $$PWD/scene/sky.h \
+    $$PWD/scene/skycache.h \
     $$PWD/scene/turtle.h \
     $$PWD/shaderprogram.h \
+    $$PWD/stagingring.h \
     $$PWD/drawable.h \
+    $$PWD/freelistallocator.h \
+    $$PWD/frustum.h \
+    $$PWD/gameloop.h \
+    $$PWD/geometryarena.h \
+    $$PWD/jobbenchmark.h \
+    $$PWD/jobhandle.h \
+    $$PWD/jobsystem.h \
+    $$PWD/mpscqueue.h \
     $$PWD/cameracontrolshelp.h \
     $$PWD/scene/cube.h \
+    $$PWD/occlusionculler.h \
+    $$PWD/renderqueue.h \
     $$PWD/openglcontext.h \
     $$PWD/scene/terrain.h \
     $$PWD/scene/worldaxes.h \
@@ -45,5 +78,13 @@ HEADERS += \
     $$PWD/scene/camera.h \
     $$PWD/playerinfo.h \
     $$PWD/scene/chunk.h \
+    $$PWD/scene/chunkgrid.h \
+    $$PWD/scene/chunkmap.h \
+    $$PWD/scene/regionfile.h \
+    $$PWD/scene/blockcodec.h \
+    $$PWD/scene/editjournal.h \
+    $$PWD/scene/zonearena.h \
     $$PWD/texture.h \
+    $$PWD/uniformbuffer.h \
+    $$PWD/uploadscheduler.h \
     $$PWD/vboworker.h
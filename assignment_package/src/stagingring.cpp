@@ -0,0 +1,112 @@
+#include "stagingring.h"
+#include <cstring>
+
+StagingRing::StagingRing(OpenGLContext *context, GLsizeiptr capacity)
+    : mp_context(context), m_buffer(0), m_capacity(capacity),
+      m_head(0), m_regionStart(0), m_regions(), m_orphans(0)
+{}
+
+void StagingRing::destroy() {
+    for(const Region &r : m_regions) {
+        mp_context->glDeleteSync(r.fence);
+    }
+    m_regions.clear();
+    if (m_buffer != 0) {
+        mp_context->glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+    m_head = 0;
+    m_regionStart = 0;
+}
+
+void StagingRing::fence() {
+    if (m_head == m_regionStart) {
+        return;
+    }
+    GLsync sync = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_regions.push_back(Region{m_regionStart, m_head, sync});
+    m_regionStart = m_head;
+}
+
+bool StagingRing::retireOldest() {
+    GLenum status = mp_context->glClientWaitSync(m_regions.front().fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return false;
+    }
+    mp_context->glDeleteSync(m_regions.front().fence);
+    m_regions.pop_front();
+    return true;
+}
+
+void StagingRing::orphan() {
+    for(const Region &r : m_regions) {
+        mp_context->glDeleteSync(r.fence);
+    }
+    m_regions.clear();
+    // The driver hands us new storage straight away and frees
+    // the old one once the GPU is done reading from it
+    mp_context->glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+    mp_context->glBufferData(GL_COPY_READ_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+    m_head = 0;
+    m_regionStart = 0;
+    ++m_orphans;
+}
+
+bool StagingRing::upload(const void *data, GLsizeiptr bytes, GLintptr dstOffset) {
+    if (bytes > m_capacity) {
+        return false;
+    }
+    if (bytes == 0) {
+        return true;
+    }
+    // The GL context doesn't exist yet when Terrain is constructed
+    if (m_buffer == 0) {
+        mp_context->glGenBuffers(1, &m_buffer);
+        mp_context->glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+        mp_context->glBufferData(GL_COPY_READ_BUFFER, m_capacity, nullptr, GL_STREAM_DRAW);
+    }
+
+    if (m_head + bytes > m_capacity) {
+        // Close off what this lap wrote before starting the next one
+        fence();
+        // Whatever the last lap left past this point is older than anything
+        // about to be overwritten, and would otherwise hide it from the check below
+        while (!m_regions.empty() && m_regions.front().start >= m_head) {
+            if (!retireOldest()) {
+                orphan();
+                break;
+            }
+        }
+        m_head = 0;
+        m_regionStart = 0;
+    }
+    // Ranges from the last lap that this write would overlap must have
+    // been read by the GPU already
+    while (!m_regions.empty() && m_regions.front().start < m_head + bytes
+           && m_regions.front().end > m_head) {
+        if (!retireOldest()) {
+            orphan();
+            break;
+        }
+    }
+
+    mp_context->glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+    void *dst = mp_context->glMapBufferRange(GL_COPY_READ_BUFFER, m_head, bytes,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst == nullptr) {
+        return false;
+    }
+    std::memcpy(dst, data, bytes);
+    mp_context->glUnmapBuffer(GL_COPY_READ_BUFFER);
+    mp_context->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, m_head, dstOffset, bytes);
+    m_head += bytes;
+    return true;
+}
+
+void StagingRing::endFrame() {
+    fence();
+}
+
+uint64_t StagingRing::orphanCount() const {
+    return m_orphans;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#include "openglcontext.h"
+#include <deque>
+
+// A single GL buffer that chunk data is streamed through on its way to
+// the Chunk's own buffers. Writes go to the next free range of the ring
+// through an unsynchronized map, so the driver never has to allocate or
+// wait, and are then copied on the GPU with glCopyBufferSubData.
+//
+// Each frame's range is guarded by a fence. When the ring wraps around
+// onto a range whose copies the GPU has not finished yet, the whole
+// buffer is orphaned instead of waiting on it.
+class StagingRing {
+private:
+    struct Region {
+        GLintptr start;
+        GLintptr end;
+        GLsync fence;
+    };
+
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+    GLsizeiptr m_capacity;
+    GLintptr m_head;
+    // Start of the range written since the last fence
+    GLintptr m_regionStart;
+    // Fenced ranges, oldest first
+    std::deque<Region> m_regions;
+
+    uint64_t m_orphans;
+
+    // Fences everything written since the last call
+    void fence();
+    // Forgets the oldest range if the GPU is done with it
+    bool retireOldest();
+    // Drops every fence and gives the buffer fresh storage
+    void orphan();
+
+public:
+    StagingRing(OpenGLContext *context, GLsizeiptr capacity);
+
+    void destroy();
+
+    // Copies bytes of data into whichever buffer is bound to
+    // GL_COPY_WRITE_BUFFER, at dstOffset. Returns false without doing
+    // anything if the data is larger than the whole ring.
+    bool upload(const void *data, GLsizeiptr bytes, GLintptr dstOffset = 0);
+    // Call once all of a frame's uploads have been issued
+    void endFrame();
+
+    // How many times the ring had to be orphaned
+    uint64_t orphanCount() const;
+};
+
+#endif // STAGINGRING_H
@@ -0,0 +1,31 @@
+#include "uniformbuffer.h"
+
+FrameUniforms::FrameUniforms()
+    : viewProj(), invViewProj(), eye(), time(0.f), dimensions(), padding()
+{}
+
+FrameUniformBuffer::FrameUniformBuffer(OpenGLContext *context)
+    : mp_context(context), m_buffer(0)
+{}
+
+void FrameUniformBuffer::create() {
+    mp_context->glGenBuffers(1, &m_buffer);
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    mp_context->glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_buffer);
+    mp_context->printGLErrorLog();
+}
+
+void FrameUniformBuffer::destroy() {
+    if (m_buffer != 0) {
+        mp_context->glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+}
+
+void FrameUniformBuffer::update(const FrameUniforms &values) {
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    // Orphan last frame's copy so this doesn't wait on draws still reading it
+    mp_context->glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    mp_context->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &values);
+}
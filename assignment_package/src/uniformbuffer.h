@@ -0,0 +1,42 @@
+#pragma once
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include "openglcontext.h"
+#include "glm_includes.h"
+
+// The binding point every program's FrameUniforms block is attached to
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+// Values that are the same for every draw in a frame. The layout matches
+// the std140 FrameUniforms block declared in the shaders.
+struct FrameUniforms {
+    glm::mat4 viewProj;
+    glm::mat4 invViewProj;
+    glm::vec3 eye;
+    float time;
+    glm::ivec2 dimensions;
+    glm::ivec2 padding;
+
+    FrameUniforms();
+};
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must match the std140 layout");
+
+// A uniform buffer holding this frame's FrameUniforms. It is uploaded
+// once per frame and stays bound, so every program reads the same values
+// without any per-program glUniform calls.
+class FrameUniformBuffer {
+private:
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+
+public:
+    FrameUniformBuffer(OpenGLContext *context);
+
+    // Creates the buffer and binds it to FRAME_UNIFORM_BINDING
+    void create();
+    void destroy();
+    void update(const FrameUniforms &values);
+};
+
+#endif // UNIFORMBUFFER_H
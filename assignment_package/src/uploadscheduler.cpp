@@ -0,0 +1,100 @@
+#include "uploadscheduler.h"
+#include "vboworker.h"
+#include <algorithm>
+#include <chrono>
+
+UploadScheduler::UploadScheduler(OpenGLContext *context)
+    : m_pending(), m_staging(context, 8 * 1024 * 1024),
+      m_byteBudget(2 * 1024 * 1024), m_timeBudgetMs(2.f),
+      m_stats{0, 0, 0.f, 0, 0, 0, 0}
+{}
+
+void UploadScheduler::destroy() {
+    m_pending.clear();
+    m_staging.destroy();
+}
+
+void UploadScheduler::setByteBudget(size_t bytes) {
+    m_byteBudget = bytes;
+}
+
+void UploadScheduler::setTimeBudgetMs(float ms) {
+    m_timeBudgetMs = ms;
+}
+
+void UploadScheduler::enqueue(const sPtr<VBOWorker> &worker) {
+    for(sPtr<VBOWorker> &w : m_pending) {
+        if (w->getChunk() == worker->getChunk()) {
+            w = worker;
+            return;
+        }
+    }
+    m_pending.push_back(worker);
+}
+
+void UploadScheduler::discard(const Chunk *c) {
+    m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(),
+                                   [c](const sPtr<VBOWorker> &w) { return w->getChunk() == c; }),
+                    m_pending.end());
+}
+
+static float distanceTo(const sPtr<VBOWorker> &w, glm::vec2 pos) {
+    const Chunk *c = w->getChunk();
+    return glm::distance(glm::vec2(c->x_offset + 8, c->z_offset + 8), pos);
+}
+
+void UploadScheduler::uploadFrame(glm::vec2 playerPos) {
+    auto start = std::chrono::steady_clock::now();
+    m_stats.frameBytes = 0;
+    m_stats.frameUploads = 0;
+
+    if (!m_pending.empty()) {
+        // Farthest first, so the nearest mesh can be popped off the back
+        std::sort(m_pending.begin(), m_pending.end(),
+                  [playerPos](const sPtr<VBOWorker> &a, const sPtr<VBOWorker> &b) {
+            return distanceTo(a, playerPos) > distanceTo(b, playerPos);
+        });
+    }
+
+    while (!m_pending.empty()) {
+        const sPtr<VBOWorker> &next = m_pending.back();
+        size_t bytes = next->getData().byteSize();
+        float elapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool overBudget = m_stats.frameBytes + bytes > m_byteBudget || elapsedMs >= m_timeBudgetMs;
+        if (m_stats.frameUploads > 0 && overBudget) {
+            break;
+        }
+        Chunk *c = next->getChunk();
+        const VBOData &data = next->getData();
+        c->bufferData(data.opaque_vertex, data.opaque_index, &m_staging);
+        c->bufferDataTrans(data.trans_vertex, data.trans_index, &m_staging);
+        c->meshMinY = data.minY;
+        c->meshMaxY = data.maxY;
+        c->occluderHeights = data.occluderHeights;
+        c->sections = data.sections;
+        c->generated = true;
+
+        m_stats.frameBytes += bytes;
+        ++m_stats.frameUploads;
+        m_pending.pop_back();
+    }
+
+    m_staging.endFrame();
+
+    m_stats.frameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_stats.peakFrameBytes = std::max(m_stats.peakFrameBytes, m_stats.frameBytes);
+    m_stats.backlogChunks = m_pending.size();
+    m_stats.stagingOrphans = m_staging.orphanCount();
+    m_stats.backlogBytes = 0;
+    for(const sPtr<VBOWorker> &w : m_pending) {
+        m_stats.backlogBytes += w->getData().byteSize();
+    }
+}
+
+UploadStats UploadScheduler::stats() const {
+    return m_stats;
+}
+
+void UploadScheduler::resetPeak() {
+    m_stats.peakFrameBytes = 0;
+}
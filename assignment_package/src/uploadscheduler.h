@@ -0,0 +1,61 @@
+#pragma once
+#ifndef UPLOADSCHEDULER_H
+#define UPLOADSCHEDULER_H
+
+#include "smartpointerhelp.h"
+#include "glm_includes.h"
+#include "stagingring.h"
+#include <vector>
+
+class VBOWorker;
+class Chunk;
+
+// What the UploadScheduler did in the most recent frame, and what it
+// still has waiting
+struct UploadStats {
+    size_t frameBytes;      // Bytes sent to the GPU in the last frame
+    int frameUploads;       // Chunks uploaded in the last frame
+    float frameMs;          // Time spent uploading in the last frame
+    size_t peakFrameBytes;  // Largest frameBytes since resetPeak()
+    size_t backlogChunks;   // Meshes still waiting to be uploaded
+    size_t backlogBytes;
+    uint64_t stagingOrphans; // Times the staging ring was full of data the GPU hadn't read yet
+};
+
+// Spreads the buffering of finished chunk meshes over several frames.
+// Meshes are queued as their jobs complete, and each frame uploads the
+// ones nearest the player until either the byte or the time budget is
+// spent; whatever is left carries over to the next frame. At least one
+// mesh is always uploaded per frame so the backlog can't stall.
+class UploadScheduler {
+private:
+    std::vector< sPtr<VBOWorker> > m_pending;
+    // Every upload is streamed through this
+    StagingRing m_staging;
+    size_t m_byteBudget;
+    float m_timeBudgetMs;
+    UploadStats m_stats;
+
+public:
+    UploadScheduler(OpenGLContext *context);
+    // Drops every mesh still waiting and frees the staging buffer.
+    // The GL context must be current.
+    void destroy();
+
+    void setByteBudget(size_t bytes);
+    void setTimeBudgetMs(float ms);
+
+    // Queues a finished mesh. Replaces any mesh for the
+    // same Chunk that has not been uploaded yet.
+    void enqueue(const sPtr<VBOWorker> &worker);
+    // Drops any queued mesh for c, which is about to be freed
+    void discard(const Chunk *c);
+    // Buffers as many queued meshes as the budgets allow, nearest
+    // to the given x-z position first. Must be called on the main thread.
+    void uploadFrame(glm::vec2 playerPos);
+
+    UploadStats stats() const;
+    void resetPeak();
+};
+
+#endif // UPLOADSCHEDULER_H
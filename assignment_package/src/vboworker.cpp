@@ -1,21 +1,52 @@
 #include "vboworker.h"
 
-VBOWorker::VBOWorker(Chunk *c)
-    : chunk(c), vbo_data(), completed(false) {}
+VBOData::VBOData()
+    : opaque_vertex(), opaque_index(), trans_vertex(), trans_index(), minY(256.f), maxY(0.f), occluderHeights(), sections()
+{}
+
+size_t VBOData::byteSize() const {
+    return (opaque_vertex.size() + trans_vertex.size()) * sizeof(glm::vec4)
+            + (opaque_index.size() + trans_index.size()) * sizeof(GLuint);
+}
+
+VBOWorker::VBOWorker(Chunk *c, JobHandle h)
+    : chunk(c), vbo_data(), handle(h), neighbor_mask(c->neighborMask()), neighbors(c->neighbors()),
+      neighbor_refs{{ChunkRef(c->getNeighbor(XPOS)), ChunkRef(c->getNeighbor(XNEG)),
+                     ChunkRef(c->getNeighbor(ZPOS)), ChunkRef(c->getNeighbor(ZNEG))}}
+{}
 
 bool VBOWorker::isCompleted() {
-    return completed;
+    return handle.isCompleted();
+}
+
+JobHandle VBOWorker::getHandle() const {
+    return handle;
 }
 
 Chunk* VBOWorker::getChunk() {
-    return chunk;
+    return chunk.get();
+}
+
+unsigned char VBOWorker::getNeighborMask() const {
+    return neighbor_mask;
 }
 
-VBOData VBOWorker::getData() {
+const VBOData& VBOWorker::getData() const {
     return vbo_data;
 }
 
 void VBOWorker::run() {
-    chunk->create(vbo_data.opaque_vertex, vbo_data.opaque_index, vbo_data.trans_vertex, vbo_data.trans_index);
-    completed = true;
+    if (!handle.isCancelled()) {
+        chunk->create(vbo_data.opaque_vertex, vbo_data.opaque_index, vbo_data.trans_vertex, vbo_data.trans_index,
+                      neighbors, &handle, &vbo_data.sections);
+        Chunk::extendVerticalExtent(vbo_data.opaque_vertex, vbo_data.minY, vbo_data.maxY);
+        Chunk::extendVerticalExtent(vbo_data.trans_vertex, vbo_data.minY, vbo_data.maxY);
+        chunk->computeOccluderHeights(vbo_data.occluderHeights);
+        handle.tryComplete();
+    }
+    // Only the chunk itself is needed once the mesh is built
+    for(ChunkRef &n : neighbor_refs) {
+        n.reset();
+    }
+    handle.exit();
 }
@@ -4,27 +4,49 @@
 
 class VBOWorker;
 
-#include <QRunnable>
 #include "scene/terrain.h"
+#include "jobhandle.h"
 
 struct VBOData {
     std::vector<glm::vec4> opaque_vertex;
     std::vector<GLuint> opaque_index;
     std::vector<glm::vec4> trans_vertex;
     std::vector<GLuint> trans_index;
+    // Vertical extent of both meshes; minY > maxY if they are empty
+    float minY, maxY;
+    // See Chunk::occluderHeights
+    std::array<int, 16> occluderHeights;
+    // See Chunk::sections
+    MeshSections sections;
+
+    VBOData();
+    // Total size of all four buffers, i.e. how much will be sent to the GPU
+    size_t byteSize() const;
 };
 
-class VBOWorker : public QRunnable {
+// Builds the interleaved VBO data for one Chunk on a JobSystem worker.
+// The data is buffered to the GPU later, on the main thread.
+// The worker holds a ChunkRef to its chunk until it is destroyed, and
+// to the neighbors it meshes against until it has run, so none of them
+// can be freed under it even if they are evicted in the meantime.
+class VBOWorker {
 private:
-    Chunk *chunk;
+    ChunkRef chunk;
     VBOData vbo_data;
-    bool completed;
+    JobHandle handle;
+    // The chunk's neighbors at the time the job was created
+    unsigned char neighbor_mask;
+    ChunkNeighbors neighbors;
+    std::array<ChunkRef, 4> neighbor_refs;
 public:
-    VBOWorker(Chunk *c);
+    // Main thread only, as it takes new references
+    VBOWorker(Chunk *c, JobHandle h);
     bool isCompleted();
+    JobHandle getHandle() const;
     Chunk* getChunk();
-    VBOData getData();
-    void run() override;
+    unsigned char getNeighborMask() const;
+    const VBOData& getData() const;
+    void run();
 };
 
 #endif // VBOWORKER_H
@@ -0,0 +1,16 @@
+# Headless round-trip tests for the block codec that saved chunks and
+# cold chunks are stored with: qmake && make && ./tst_blockcodec
+QT += testlib widgets
+
+TARGET = tst_blockcodec
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG += c++1z
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../include ../../src
+
+SOURCES += tst_blockcodec.cpp \
+    ../../src/scene/blockcodec.cpp
+
+HEADERS += ../../src/scene/blockcodec.h
@@ -0,0 +1,269 @@
+#include <QtTest>
+#include "scene/blockcodec.h"
+#include <cstdint>
+
+// Every block type, in an order no run of the codec lines up with
+static void fillPseudoRandom(ChunkBlocks &blocks, uint32_t seed) {
+    for(BlockType &b : blocks) {
+        seed = seed * 1664525u + 1013904223u;
+        b = static_cast<BlockType>((seed >> 16) % (WATER + 1));
+    }
+}
+
+// Changes count evenly spread blocks of blocks to something else
+static void changeBlocks(ChunkBlocks &blocks, size_t count) {
+    size_t step = blocks.size() / count;
+    for(size_t i = 0; i < count; ++i) {
+        BlockType &b = blocks[i * step];
+        b = static_cast<BlockType>((b + 1) % (WATER + 1));
+    }
+}
+
+// Decodes out, on top of generated if it is a delta
+static bool roundTrip(const std::vector<unsigned char> &out, const ChunkBlocks *generated, ChunkBlocks &decoded) {
+    decoded.fill(EMPTY);
+    if (BlockCodec::isDelta(out.data(), out.size())) {
+        if (generated == nullptr) {
+            return false;
+        }
+        decoded = *generated;
+    }
+    return BlockCodec::decode(out.data(), out.size(), decoded);
+}
+
+class TestBlockCodec : public QObject {
+    Q_OBJECT
+
+private slots:
+    void emptyChunk();
+    void singleBlockChunk();
+    void paletteBeatsRuns();
+    void paletteSizes_data();
+    void paletteSizes();
+    void paletteRunLengths_data();
+    void paletteRunLengths();
+    void sparseDelta();
+    void bitmapDelta();
+    void sparseBitmapCutoff();
+    void fullEncodingBeatsDelta();
+    void untaggedRuns();
+    void damagedPayloads();
+};
+
+void TestBlockCodec::emptyChunk() {
+    ChunkBlocks blocks;
+    blocks.fill(EMPTY);
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, nullptr, out);
+    // One run: the tag and a single (type, length) triple
+    QCOMPARE(int(out.size()), 4);
+    QCOMPARE(int(out[0]), int(BlockCodec::RUNS));
+    ChunkBlocks decoded;
+    decoded.fill(STONE);
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::singleBlockChunk() {
+    ChunkBlocks blocks;
+    blocks.fill(STONE);
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, nullptr, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::RUNS));
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+
+    // Packed for a cold chunk, the palette has just the one entry
+    out.clear();
+    BlockCodec::encodePalette(blocks, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::PALETTE));
+    QCOMPARE(int(out[1]), 0);
+    QCOMPARE(int(out[2]), int(STONE));
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::paletteBeatsRuns() {
+    // Short runs of few types cost a byte each as PALETTE, three as RUNS
+    ChunkBlocks blocks;
+    for(size_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = (i / 3) % 2 ? GRASS : DIRT;
+    }
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, nullptr, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::PALETTE));
+    QVERIFY(!BlockCodec::isDelta(out.data(), out.size()));
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::paletteSizes_data() {
+    QTest::addColumn<int>("types");
+    // Where the index width steps from 0 up to 3 bits
+    QTest::newRow("1") << 1;
+    QTest::newRow("2") << 2;
+    QTest::newRow("3") << 3;
+    QTest::newRow("4") << 4;
+    QTest::newRow("5") << 5;
+    QTest::newRow("8") << 8;
+}
+
+void TestBlockCodec::paletteSizes() {
+    QFETCH(int, types);
+    ChunkBlocks blocks;
+    for(size_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = static_cast<BlockType>((i / 7) % types);
+    }
+    std::vector<unsigned char> out;
+    BlockCodec::encodePalette(blocks, out);
+    QCOMPARE(int(out[1]) + 1, types);
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+
+    out.clear();
+    BlockCodec::encode(blocks, nullptr, out);
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::paletteRunLengths_data() {
+    QTest::addColumn<int>("run");
+    // Either side of where a run's varint grows a byte with a 3-bit index
+    QTest::newRow("1") << 1;
+    QTest::newRow("16") << 16;
+    QTest::newRow("17") << 17;
+    QTest::newRow("2048") << 2048;
+    QTest::newRow("2049") << 2049;
+    QTest::newRow("whole chunk") << 65536;
+}
+
+void TestBlockCodec::paletteRunLengths() {
+    QFETCH(int, run);
+    ChunkBlocks blocks;
+    for(size_t i = 0; i < blocks.size(); ++i) {
+        blocks[i] = static_cast<BlockType>((i / run) % (WATER + 1));
+    }
+    // All eight types at the front keep the index at its widest
+    for(int t = 0; t <= WATER && run == int(blocks.size()); ++t) {
+        blocks[t] = static_cast<BlockType>(t);
+    }
+    std::vector<unsigned char> out;
+    BlockCodec::encodePalette(blocks, out);
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::sparseDelta() {
+    ChunkBlocks generated;
+    fillPseudoRandom(generated, 1);
+    ChunkBlocks blocks = generated;
+    changeBlocks(blocks, 10);
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, &generated, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::SPARSE));
+    QCOMPARE(int(out.size()), 1 + 3 * 10);
+    QVERIFY(BlockCodec::isDelta(out.data(), out.size()));
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, &generated, decoded));
+    QVERIFY(decoded == blocks);
+
+    // Nothing changed at all
+    out.clear();
+    BlockCodec::encode(generated, &generated, out);
+    QCOMPARE(int(out.size()), 1);
+    QVERIFY(roundTrip(out, &generated, decoded));
+    QVERIFY(decoded == generated);
+}
+
+void TestBlockCodec::bitmapDelta() {
+    ChunkBlocks generated;
+    fillPseudoRandom(generated, 2);
+    ChunkBlocks blocks = generated;
+    changeBlocks(blocks, 16384);
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, &generated, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::BITMAP));
+    QCOMPARE(int(out.size()), int(1 + blocks.size() / 8 + 16384));
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, &generated, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::sparseBitmapCutoff() {
+    // SPARSE costs 3 bytes a change and BITMAP 8 KiB plus 1 a change,
+    // so they tie at 4096 changes, where SPARSE is kept
+    ChunkBlocks generated;
+    fillPseudoRandom(generated, 3);
+    for(int changes : {4096, 4097}) {
+        ChunkBlocks blocks = generated;
+        changeBlocks(blocks, changes);
+        std::vector<unsigned char> out;
+        BlockCodec::encode(blocks, &generated, out);
+        QCOMPARE(int(out[0]), int(changes == 4096 ? BlockCodec::SPARSE : BlockCodec::BITMAP));
+        ChunkBlocks decoded;
+        QVERIFY(roundTrip(out, &generated, decoded));
+        QVERIFY(decoded == blocks);
+    }
+}
+
+void TestBlockCodec::fullEncodingBeatsDelta() {
+    // Everything differs from generation, but the blocks themselves are simple
+    ChunkBlocks generated;
+    fillPseudoRandom(generated, 4);
+    ChunkBlocks blocks;
+    blocks.fill(EMPTY);
+    std::fill_n(blocks.begin(), 16 * 256 * 8, STONE);
+    std::vector<unsigned char> out;
+    BlockCodec::encode(blocks, &generated, out);
+    QCOMPARE(int(out[0]), int(BlockCodec::RUNS));
+    QVERIFY(!BlockCodec::isDelta(out.data(), out.size()));
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, &generated, decoded));
+    QVERIFY(decoded == blocks);
+}
+
+void TestBlockCodec::untaggedRuns() {
+    // Saved before the tag byte existed: half DIRT, half EMPTY
+    std::vector<unsigned char> out = {DIRT, 0xff, 0x7f, EMPTY, 0xff, 0x7f};
+    ChunkBlocks decoded;
+    QVERIFY(roundTrip(out, nullptr, decoded));
+    QCOMPARE(int(decoded[0]), int(DIRT));
+    QCOMPARE(int(decoded[32767]), int(DIRT));
+    QCOMPARE(int(decoded[32768]), int(EMPTY));
+}
+
+void TestBlockCodec::damagedPayloads() {
+    ChunkBlocks blocks;
+    fillPseudoRandom(blocks, 5);
+    ChunkBlocks decoded;
+    std::vector<unsigned char> out;
+
+    // Cut short
+    BlockCodec::encodePalette(blocks, out);
+    out.resize(out.size() / 2);
+    decoded.fill(STONE);
+    QVERIFY(!BlockCodec::decode(out.data(), out.size(), decoded));
+    QCOMPARE(int(decoded[0]), int(EMPTY));
+    QCOMPARE(int(decoded[blocks.size() - 1]), int(EMPTY));
+
+    // Runs that overrun the chunk
+    out = {BlockCodec::RUNS, STONE, 0xff, 0xff, STONE, 0, 0};
+    QVERIFY(!BlockCodec::decode(out.data(), out.size(), decoded));
+
+    // Not a block type
+    out = {BlockCodec::RUNS, WATER + 1, 0xff, 0xff};
+    QVERIFY(!BlockCodec::decode(out.data(), out.size(), decoded));
+
+    // No such format, and nothing at all
+    out = {0xff};
+    QVERIFY(!BlockCodec::decode(out.data(), out.size(), decoded));
+    QVERIFY(!BlockCodec::decode(nullptr, 0, decoded));
+}
+
+QTEST_APPLESS_MAIN(TestBlockCodec)
+
+#include "tst_blockcodec.moc"
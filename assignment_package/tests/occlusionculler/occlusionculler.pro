@@ -0,0 +1,19 @@
+# Headless tests for the software occlusion culler. It needs no GL
+# context, so these run anywhere: qmake && make && ./tst_occlusionculler
+QT += testlib
+QT -= gui
+
+TARGET = tst_occlusionculler
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG += c++1z
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../include ../../src
+
+SOURCES += tst_occlusionculler.cpp \
+    ../../src/occlusionculler.cpp \
+    ../../src/frustum.cpp
+
+HEADERS += ../../src/occlusionculler.h \
+    ../../src/frustum.h
@@ -0,0 +1,162 @@
+#include <QtTest>
+#include <algorithm>
+#include "occlusionculler.h"
+
+// With an identity viewProj, world x and y in [-1, 1] map straight
+// onto the screen and world z is the depth
+static glm::vec2 toScreen(float x, float y) {
+    return glm::vec2((x * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+                     (y * 0.5f + 0.5f) * OcclusionCuller::HEIGHT);
+}
+
+// The world x whose screen position is sx
+static float fromScreenX(float sx) {
+    return sx / OcclusionCuller::WIDTH * 2.f - 1.f;
+}
+
+static float fromScreenY(float sy) {
+    return sy / OcclusionCuller::HEIGHT * 2.f - 1.f;
+}
+
+class TestOcclusionCuller : public QObject {
+    Q_OBJECT
+
+private slots:
+    void emptyBufferHidesNothing();
+    void writesNearestFaceDepth();
+    void skipsPartlyCoveredTexels();
+    void pyramidKeepsFurthestDepth();
+    void hidesBoxesBehindOccluder();
+    void keepsBoxesNotFullyBehindOccluder();
+    void keepsBoxesPastScreenEdge();
+    void perspectiveView();
+};
+
+void TestOcclusionCuller::emptyBufferHidesNothing() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    culler.buildPyramid();
+    for(int l = 0; l < culler.levelCount(); ++l) {
+        glm::ivec2 size = culler.levelSize(l);
+        for(int y = 0; y < size.y; ++y) {
+            for(int x = 0; x < size.x; ++x) {
+                QCOMPARE(culler.depthAt(l, x, y), 1.f);
+            }
+        }
+    }
+    QVERIFY(culler.isVisible(AABB{glm::vec3(-0.1f, -0.1f, 0.5f), glm::vec3(0.1f, 0.1f, 0.6f)}));
+}
+
+void TestOcclusionCuller::writesNearestFaceDepth() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    culler.rasterizeOccluder(AABB{glm::vec3(-0.5f, -0.5f, 0.2f), glm::vec3(0.5f, 0.5f, 0.3f)});
+    // Inside, the -z face at 0.2 is the nearest
+    glm::vec2 centre = toScreen(0.f, 0.f);
+    QCOMPARE(culler.depthAt(0, int(centre.x), int(centre.y)), 0.2f);
+    // Outside, untouched
+    QCOMPARE(culler.depthAt(0, 0, 0), 1.f);
+    QCOMPARE(culler.depthAt(0, OcclusionCuller::WIDTH - 1, OcclusionCuller::HEIGHT - 1), 1.f);
+}
+
+void TestOcclusionCuller::skipsPartlyCoveredTexels() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    // Left and bottom edges half way across texels 64 and 32, right and
+    // top edges half way across texels 191 and 95
+    float x0 = fromScreenX(64.5f), x1 = fromScreenX(191.5f);
+    float y0 = fromScreenY(32.5f), y1 = fromScreenY(95.5f);
+    culler.rasterizeOccluder(AABB{glm::vec3(x0, y0, 0.2f), glm::vec3(x1, y1, 0.3f)});
+    // The pixel centres of the edge texels are covered, but not the texels
+    QCOMPARE(culler.depthAt(0, 64, 60), 1.f);
+    QCOMPARE(culler.depthAt(0, 191, 60), 1.f);
+    QCOMPARE(culler.depthAt(0, 100, 32), 1.f);
+    QCOMPARE(culler.depthAt(0, 100, 95), 1.f);
+    QVERIFY(culler.depthAt(0, 65, 60) < 1.f);
+    QVERIFY(culler.depthAt(0, 190, 60) < 1.f);
+    QVERIFY(culler.depthAt(0, 100, 33) < 1.f);
+    QVERIFY(culler.depthAt(0, 100, 94) < 1.f);
+}
+
+void TestOcclusionCuller::pyramidKeepsFurthestDepth() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    culler.rasterizeOccluder(AABB{glm::vec3(-0.5f, -0.5f, 0.2f), glm::vec3(0.5f, 0.5f, 0.3f)});
+    culler.buildPyramid();
+    QCOMPARE(culler.levelSize(0), glm::ivec2(OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT));
+    QCOMPARE(culler.levelSize(culler.levelCount() - 1), glm::ivec2(1, 1));
+    for(int l = 1; l < culler.levelCount(); ++l) {
+        glm::ivec2 size = culler.levelSize(l);
+        glm::ivec2 below = culler.levelSize(l - 1);
+        QCOMPARE(size, glm::max(below / 2, glm::ivec2(1)));
+        for(int y = 0; y < size.y; ++y) {
+            for(int x = 0; x < size.x; ++x) {
+                float furthest = 0.f;
+                for(int dy = 0; dy < 2; ++dy) {
+                    for(int dx = 0; dx < 2; ++dx) {
+                        furthest = std::max(furthest, culler.depthAt(l - 1, std::min(2 * x + dx, below.x - 1),
+                                                                     std::min(2 * y + dy, below.y - 1)));
+                    }
+                }
+                QCOMPARE(culler.depthAt(l, x, y), furthest);
+            }
+        }
+    }
+    // The occluder only covers part of the screen
+    QCOMPARE(culler.depthAt(culler.levelCount() - 1, 0, 0), 1.f);
+}
+
+void TestOcclusionCuller::hidesBoxesBehindOccluder() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    culler.rasterizeOccluder(AABB{glm::vec3(-0.5f, -0.5f, 0.2f), glm::vec3(0.5f, 0.5f, 0.3f)});
+    culler.buildPyramid();
+    QVERIFY(!culler.isVisible(AABB{glm::vec3(-0.05f, -0.05f, 0.5f), glm::vec3(0.05f, 0.05f, 0.6f)}));
+    QVERIFY(!culler.isVisible(AABB{glm::vec3(-0.01f, -0.01f, 0.9f), glm::vec3(0.01f, 0.01f, 0.95f)}));
+}
+
+void TestOcclusionCuller::keepsBoxesNotFullyBehindOccluder() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    culler.rasterizeOccluder(AABB{glm::vec3(-0.5f, -0.5f, 0.2f), glm::vec3(0.5f, 0.5f, 0.3f)});
+    culler.buildPyramid();
+    // In front of it
+    QVERIFY(culler.isVisible(AABB{glm::vec3(-0.25f, -0.25f, 0.f), glm::vec3(0.25f, 0.25f, 0.1f)}));
+    // Passing through it
+    QVERIFY(culler.isVisible(AABB{glm::vec3(-0.25f, -0.25f, 0.25f), glm::vec3(0.25f, 0.25f, 0.6f)}));
+    // Behind it, but sticking out past its side
+    QVERIFY(culler.isVisible(AABB{glm::vec3(0.25f, -0.25f, 0.5f), glm::vec3(0.75f, 0.25f, 0.6f)}));
+    // Behind it, and just past its edge
+    QVERIFY(culler.isVisible(AABB{glm::vec3(0.51f, -0.1f, 0.5f), glm::vec3(0.52f, 0.1f, 0.6f)}));
+}
+
+void TestOcclusionCuller::keepsBoxesPastScreenEdge() {
+    OcclusionCuller culler;
+    culler.begin(glm::mat4(1.f));
+    // Covers the whole screen and then some
+    culler.rasterizeOccluder(AABB{glm::vec3(-2.f, -2.f, 0.2f), glm::vec3(2.f, 2.f, 0.3f)});
+    culler.buildPyramid();
+    QVERIFY(!culler.isVisible(AABB{glm::vec3(0.5f, -0.25f, 0.5f), glm::vec3(0.9f, 0.25f, 0.6f)}));
+    // Nothing is known about what is off screen
+    QVERIFY(culler.isVisible(AABB{glm::vec3(0.5f, -0.25f, 0.5f), glm::vec3(1.5f, 0.25f, 0.6f)}));
+}
+
+void TestOcclusionCuller::perspectiveView() {
+    glm::mat4 proj = glm::perspective(glm::radians(90.f), 2.f, 0.1f, 1000.f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+    OcclusionCuller culler;
+    culler.begin(proj * view);
+    // A wall ten blocks ahead
+    culler.rasterizeOccluder(AABB{glm::vec3(-8.f, -4.f, -11.f), glm::vec3(8.f, 4.f, -10.f)});
+    culler.buildPyramid();
+    QVERIFY(!culler.isVisible(AABB{glm::vec3(-1.f, -1.f, -31.f), glm::vec3(1.f, 1.f, -30.f)}));
+    // Off to the side of the wall
+    QVERIFY(culler.isVisible(AABB{glm::vec3(30.f, -1.f, -31.f), glm::vec3(32.f, 1.f, -30.f)}));
+    // Behind the camera, or around it
+    QVERIFY(culler.isVisible(AABB{glm::vec3(-1.f, -1.f, 5.f), glm::vec3(1.f, 1.f, 6.f)}));
+    QVERIFY(culler.isVisible(AABB{glm::vec3(-1.f, -1.f, -1.f), glm::vec3(1.f, 1.f, 1.f)}));
+}
+
+QTEST_APPLESS_MAIN(TestOcclusionCuller)
+
+#include "tst_occlusionculler.moc"